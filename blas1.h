@@ -0,0 +1,317 @@
+#ifndef BLAS1_H
+#define BLAS1_H
+
+/* Header-only parallel-for/reduce over a persistent thread pool plus a few
+ * BLAS level 1 kernels on doubles. Include it and build with -pthread -lm. */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BLAS1_CACHE_LINE 64
+#define BLAS1_SPIN 4096
+
+typedef double (*blas1_kernel_fn)(void *ctx, int start, int end);
+
+typedef struct {
+  double value;
+  char pad[BLAS1_CACHE_LINE - sizeof(double)];
+} Blas1Partial;
+
+typedef struct Blas1Pool Blas1Pool;
+
+typedef struct {
+  Blas1Pool *pool;
+  int thread_id;
+} Blas1WorkerArgs;
+
+struct Blas1Pool {
+  int n_threads;
+  pthread_t *threads;
+  Blas1WorkerArgs *worker_args;
+  Blas1Partial *partials;
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  atomic_uint generation;
+  atomic_int pending;
+  int shutdown;
+  blas1_kernel_fn fn;
+  void *ctx;
+  int n;
+};
+
+typedef struct {
+  const double *x;
+  double *y;
+  double alpha;
+} Blas1Args;
+
+static inline void blas1_error(const char *err) {
+  perror(err);
+  exit(EXIT_FAILURE);
+}
+
+/* Same split the programs used inline: n / n_parts each, the first
+ * n % n_parts parts get one extra element. */
+static inline void blas1_range(int n, int n_parts, int part, int *start,
+                               int *end) {
+  int per_part = n / n_parts;
+  int remainder = n % n_parts;
+  *start = part * per_part + (part < remainder ? part : remainder);
+  *end = *start + per_part + (part < remainder ? 1 : 0);
+}
+
+static inline void blas1_run_part(Blas1Pool *pool, int thread_id) {
+  int start, end;
+  blas1_range(pool->n, pool->n_threads, thread_id, &start, &end);
+  pool->partials[thread_id].value = pool->fn(pool->ctx, start, end);
+}
+
+static inline void *blas1_worker(void *arg) {
+  Blas1WorkerArgs *args = (Blas1WorkerArgs *)arg;
+  Blas1Pool *pool = args->pool;
+  unsigned seen = 0;
+
+  while (1) {
+    unsigned gen;
+    for (int spins = 0; spins < BLAS1_SPIN; ++spins) {
+      gen = atomic_load_explicit(&pool->generation, memory_order_acquire);
+      if (gen != seen)
+        break;
+    }
+    if (gen == seen) {
+      pthread_mutex_lock(&pool->mutex);
+      while ((gen = atomic_load(&pool->generation)) == seen)
+        pthread_cond_wait(&pool->work_cond, &pool->mutex);
+      pthread_mutex_unlock(&pool->mutex);
+    }
+    seen = gen;
+
+    if (pool->shutdown)
+      break;
+
+    blas1_run_part(pool, args->thread_id);
+
+    if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+      pthread_mutex_lock(&pool->mutex);
+      pthread_cond_signal(&pool->done_cond);
+      pthread_mutex_unlock(&pool->mutex);
+    }
+  }
+  return NULL;
+}
+
+/* n_threads counts the caller, which always runs part 0 itself. */
+static inline Blas1Pool *blas1_pool_create(int n_threads) {
+  if (n_threads <= 0)
+    n_threads = 1;
+
+  Blas1Pool *pool = (Blas1Pool *)calloc(1, sizeof(Blas1Pool));
+  if (!pool)
+    blas1_error("blas1_pool_create: calloc pool");
+
+  pool->n_threads = n_threads;
+  pool->threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+  pool->worker_args =
+      (Blas1WorkerArgs *)malloc(n_threads * sizeof(Blas1WorkerArgs));
+  pool->partials = (Blas1Partial *)aligned_alloc(
+      BLAS1_CACHE_LINE, n_threads * sizeof(Blas1Partial));
+  if (!pool->threads || !pool->worker_args || !pool->partials)
+    blas1_error("blas1_pool_create: malloc");
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  atomic_init(&pool->generation, 0);
+  atomic_init(&pool->pending, 0);
+
+  for (int i = 1; i < n_threads; ++i) {
+    pool->worker_args[i].pool = pool;
+    pool->worker_args[i].thread_id = i;
+    if (pthread_create(&pool->threads[i], NULL, blas1_worker,
+                       (void *)&pool->worker_args[i]) != 0)
+      blas1_error("blas1_pool_create: pthread_create");
+  }
+  return pool;
+}
+
+static inline void blas1_pool_destroy(Blas1Pool *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = 1;
+  atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int i = 1; i < pool->n_threads; ++i)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_cond_destroy(&pool->done_cond);
+  free(pool->threads);
+  free(pool->worker_args);
+  free(pool->partials);
+  free(pool);
+}
+
+/* Runs fn over [0, n) split across the pool and leaves each part's result
+ * in pool->partials. */
+static inline void blas1_parallel_run(Blas1Pool *pool, int n,
+                                      blas1_kernel_fn fn, void *ctx) {
+  pool->fn = fn;
+  pool->ctx = ctx;
+  pool->n = n;
+
+  if (pool->n_threads > 1) {
+    atomic_store(&pool->pending, pool->n_threads - 1);
+    pthread_mutex_lock(&pool->mutex);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  blas1_run_part(pool, 0);
+
+  if (pool->n_threads > 1) {
+    for (int spins = 0; spins < BLAS1_SPIN; ++spins)
+      if (atomic_load_explicit(&pool->pending, memory_order_acquire) == 0)
+        break;
+    pthread_mutex_lock(&pool->mutex);
+    while (atomic_load(&pool->pending) > 0)
+      pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+/* Partial results added in thread order, so the reduction order is fixed
+ * for a given pool. */
+static inline double blas1_parallel_reduce(Blas1Pool *pool, int n,
+                                           blas1_kernel_fn fn, void *ctx) {
+  blas1_parallel_run(pool, n, fn, ctx);
+  double total = 0.0;
+  for (int i = 0; i < pool->n_threads; ++i)
+    total += pool->partials[i].value;
+  return total;
+}
+
+/* Largest partial result; a NaN part makes the result NaN. */
+static inline double blas1_parallel_max(Blas1Pool *pool, int n,
+                                        blas1_kernel_fn fn, void *ctx) {
+  blas1_parallel_run(pool, n, fn, ctx);
+  double max = 0.0;
+  for (int i = 0; i < pool->n_threads; ++i)
+    if (!(pool->partials[i].value <= max))
+      max = pool->partials[i].value;
+  return max;
+}
+
+static inline void blas1_parallel_for(Blas1Pool *pool, int n,
+                                      blas1_kernel_fn fn, void *ctx) {
+  blas1_parallel_reduce(pool, n, fn, ctx);
+}
+
+static inline double blas1_dot_kernel(void *ctx, int start, int end) {
+  const Blas1Args *args = (const Blas1Args *)ctx;
+  const double *restrict x = args->x;
+  const double *restrict y = args->y;
+  double sum = 0.0;
+  for (int i = start; i < end; ++i)
+    sum += x[i] * y[i];
+  return sum;
+}
+
+static inline double blas1_axpy_kernel(void *ctx, int start, int end) {
+  const Blas1Args *args = (const Blas1Args *)ctx;
+  const double *restrict x = args->x;
+  double *restrict y = args->y;
+  double alpha = args->alpha;
+  for (int i = start; i < end; ++i)
+    y[i] += alpha * x[i];
+  return 0.0;
+}
+
+static inline double blas1_scale_kernel(void *ctx, int start, int end) {
+  const Blas1Args *args = (const Blas1Args *)ctx;
+  double *restrict y = args->y;
+  double alpha = args->alpha;
+  for (int i = start; i < end; ++i)
+    y[i] *= alpha;
+  return 0.0;
+}
+
+static inline double blas1_amax_kernel(void *ctx, int start, int end) {
+  const Blas1Args *args = (const Blas1Args *)ctx;
+  const double *restrict x = args->x;
+  double max = 0.0;
+  for (int i = start; i < end; ++i)
+    if (!(fabs(x[i]) <= max))
+      max = fabs(x[i]);
+  return max;
+}
+
+/* Sum of (x[i] / alpha)^2; with alpha = max |x[i]| every term is at most 1,
+ * so it neither overflows nor loses the small elements to underflow. */
+static inline double blas1_scaled_sumsq_kernel(void *ctx, int start,
+                                               int end) {
+  const Blas1Args *args = (const Blas1Args *)ctx;
+  const double *restrict x = args->x;
+  double inv = 1.0 / args->alpha;
+  double sum = 0.0;
+  for (int i = start; i < end; ++i) {
+    double v = x[i] * inv;
+    sum += v * v;
+  }
+  return sum;
+}
+
+static inline double blas1_sum_kernel(void *ctx, int start, int end) {
+  const Blas1Args *args = (const Blas1Args *)ctx;
+  const double *restrict x = args->x;
+  double sum = 0.0;
+  for (int i = start; i < end; ++i)
+    sum += x[i];
+  return sum;
+}
+
+static inline double blas1_dot(Blas1Pool *pool, int n, const double *x,
+                               const double *y) {
+  Blas1Args args = {x, (double *)y, 0.0};
+  return blas1_parallel_reduce(pool, n, blas1_dot_kernel, &args);
+}
+
+/* y = alpha * x + y */
+static inline void blas1_axpy(Blas1Pool *pool, int n, double alpha,
+                              const double *x, double *y) {
+  Blas1Args args = {x, y, alpha};
+  blas1_parallel_for(pool, n, blas1_axpy_kernel, &args);
+}
+
+/* x = alpha * x */
+static inline void blas1_scale(Blas1Pool *pool, int n, double alpha,
+                               double *x) {
+  Blas1Args args = {NULL, x, alpha};
+  blas1_parallel_for(pool, n, blas1_scale_kernel, &args);
+}
+
+/* Euclidean norm computed as scale * sqrt(ssq) like the BLAS nrm2: one
+ * pass finds scale = max |x[i]|, a second adds the squares of x[i] / scale
+ * in the ordered reduce, so it is finite whenever the norm is. */
+static inline double blas1_nrm2(Blas1Pool *pool, int n, const double *x) {
+  Blas1Args args = {x, NULL, 0.0};
+  double scale = blas1_parallel_max(pool, n, blas1_amax_kernel, &args);
+  if (scale == 0.0 || !isfinite(scale))
+    return scale;
+  args.alpha = scale;
+  return scale *
+         sqrt(blas1_parallel_reduce(pool, n, blas1_scaled_sumsq_kernel, &args));
+}
+
+static inline double blas1_sum(Blas1Pool *pool, int n, const double *x) {
+  Blas1Args args = {x, NULL, 0.0};
+  return blas1_parallel_reduce(pool, n, blas1_sum_kernel, &args);
+}
+
+#endif
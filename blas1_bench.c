@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "blas1.h"
+
+typedef struct {
+  const double *x;
+  const double *y;
+  int start;
+  int end;
+  double partial_sum;
+} ThreadArgs;
+
+void error(const char *err) {
+  perror(err);
+  exit(EXIT_FAILURE);
+}
+
+double elapsed_seconds(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void *spawn_dot(void *arg) {
+  ThreadArgs *args = (ThreadArgs *)arg;
+  double sum = 0.0;
+  for (int i = args->start; i < args->end; ++i)
+    sum += args->x[i] * args->y[i];
+  args->partial_sum = sum;
+  return NULL;
+}
+
+double dot_spawn_per_call(int n, int n_threads, const double *x,
+                          const double *y) {
+  pthread_t threads[n_threads];
+  ThreadArgs thread_args[n_threads];
+
+  for (int i = 0; i < n_threads; ++i) {
+    thread_args[i].x = x;
+    thread_args[i].y = y;
+    blas1_range(n, n_threads, i, &thread_args[i].start, &thread_args[i].end);
+    if (pthread_create(&threads[i], NULL, spawn_dot, (void *)&thread_args[i]) != 0)
+      error("error pthread_create");
+  }
+
+  double total = 0.0;
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+    total += thread_args[i].partial_sum;
+  }
+  return total;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4)
+    error("Usage: <n_elements> <n_threads> <n_calls>");
+
+  int n = atoi(argv[1]);
+  int n_threads = atoi(argv[2]);
+  int n_calls = atoi(argv[3]);
+  if (n <= 0 || n_threads <= 0 || n_calls <= 0)
+    error("arguments must be greater than 0");
+
+  double *x = (double *)malloc(n * sizeof(double));
+  double *y = (double *)malloc(n * sizeof(double));
+  if (!x || !y)
+    error("error malloc vectors");
+
+  for (int i = 0; i < n; ++i) {
+    x[i] = (double)rand() / RAND_MAX;
+    y[i] = (double)rand() / RAND_MAX;
+  }
+
+  struct timespec t_start, t_end;
+  volatile double sink = 0.0;
+
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  for (int c = 0; c < n_calls; ++c)
+    sink += dot_spawn_per_call(n, n_threads, x, y);
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double spawn_time = elapsed_seconds(t_start, t_end);
+
+  Blas1Pool *pool = blas1_pool_create(n_threads);
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  for (int c = 0; c < n_calls; ++c)
+    sink += blas1_dot(pool, n, x, y);
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double pool_time = elapsed_seconds(t_start, t_end);
+
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  for (int c = 0; c < n_calls; ++c) {
+    blas1_axpy(pool, n, 1e-9, x, y);
+    blas1_scale(pool, n, 1.0, y);
+    sink += blas1_nrm2(pool, n, y) + blas1_sum(pool, n, x);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double kernels_time = elapsed_seconds(t_start, t_end);
+  blas1_pool_destroy(pool);
+
+  printf("dot spawn-per-call: %.3f us/call\n", spawn_time / n_calls * 1e6);
+  printf("dot thread pool:    %.3f us/call\n", pool_time / n_calls * 1e6);
+  printf("axpy+scale+nrm2+sum pool: %.3f us/call\n",
+         kernels_time / (4.0 * n_calls) * 1e6);
+  printf("speedup pool vs spawn: %.2fx\n", spawn_time / pool_time);
+
+  free(x);
+  free(y);
+  return EXIT_SUCCESS;
+}
@@ -1,29 +1,102 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <ftw.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-#define BUFFER_LINES 3
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-char *buffer_lines[BUFFER_LINES];
-int lines_in_buffer;
-int current_line = 0;
-int terminated = 0;
+#include "blas1.h"
 
-int total_lines = 0;
-int total_comments = 0;
-int total_keywords = 0;
+#define BATCH_BYTES (1 << 16)
+#define RING_SLOTS 1024
+#define N_CONSUMERS 3
+#define MAX_KEYWORDS 64
+#define MAX_HASH_SEEDS 100000
+#define CHUNK_BYTES (1 << 20)
+#define SCAN_BLOCK 64
+#define BENCH_SCAN_BYTES (1L << 30)
+#define CACHE_MAGIC "code_analyzer-cache v2"
 
-const char *keywords[] = {"int", "float", "char",   "if",     "else",
-                          "for", "while", "return", "switch", "case"};
-const int n_keywords = sizeof(keywords) / sizeof(keywords[0]);
+/* Whole lines in one contiguous buffer, so consumers can scan a batch as a
+ * block of bytes. Only the last batch of a file may end without '\n'. */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} LineBatch;
+
+LineBatch ring[RING_SLOTS];
+atomic_long write_cursor = 0;
+atomic_long read_cursors[N_CONSUMERS];
+atomic_int reader_done = 0;
+
+typedef enum { OUTPUT_TEXT, OUTPUT_JSON, OUTPUT_CSV } OutputFormat;
+
+typedef struct {
+  long lines;
+  long comment_lines;
+  int in_block;
+} ScanResult;
+
+typedef struct {
+  long count;
+  long lines;
+  long keyword_counts[MAX_KEYWORDS];
+  double busy_seconds;
+  ScanResult scan;
+} ConsumerStats;
+
+typedef struct {
+  const char *path;
+  long lines;
+  long comment_lines;
+  const long *keyword_counts;
+} FileReport;
+
+typedef struct {
+  const char *name;
+  double seconds;
+  long lines;
+  long bytes;
+} StageTiming;
+
+typedef struct {
+  long hits;
+  long revalidated;
+  long misses;
+  long dropped;
+  double load_seconds;
+  double save_seconds;
+} CacheStats;
+
+ConsumerStats consumer_stats[N_CONSUMERS];
+OutputFormat output_format = OUTPUT_TEXT;
+
+const char *default_keywords[] = {"int", "float", "char",   "if",     "else",
+                                  "for", "while", "return", "switch", "case"};
+const char *keywords[MAX_KEYWORDS];
+size_t keyword_lengths[MAX_KEYWORDS];
+int n_keywords = 0;
 const char *token_delimiters = " \t\n\r;(){}[]<>=+-*/%!&|,.\"'";
 
-pthread_barrier_t barrier_start;
-pthread_barrier_t barrier_end;
-pthread_mutex_t buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+unsigned char is_delimiter[256];
+int *keyword_table;
+uint32_t keyword_table_mask;
+uint32_t keyword_hash_seed;
 
 void error(const char *err) {
   perror(err);
@@ -38,187 +111,1374 @@ void println(const char *fmt, ...) {
   putchar('\n');
 }
 
-int has_comment_inline(const char *line) {
-  int in_string = 0;
+/* The one definition of a comment line, shared by every mode: a line is
+ * commented if any of its bytes is inside a // or a block comment. String
+ * and char literals are skipped and never span lines; only the block
+ * comment state carries over to the next line. */
+int scan_comment_line(const char *p, const char *end, int *in_block) {
+  int has_comment = 0;
+  char quote = 0;
 
-  for (const char *p = line; *p; ++p) {
-    if (*p == '"' && (p == line || *(p - 1) != '\\')) {
-      in_string = !in_string; 
-    }
-    if (!in_string && *p == '/' && *(p + 1) == '/') {
-      return 1; 
+  for (; p < end; ++p) {
+    if (*in_block) {
+      has_comment = 1;
+      if (*p == '*' && p + 1 < end && p[1] == '/') {
+        *in_block = 0;
+        p++;
+      }
+    } else if (quote) {
+      if (*p == '\\')
+        p++;
+      else if (*p == quote)
+        quote = 0;
+    } else if (*p == '"' || *p == '\'') {
+      quote = *p;
+    } else if (*p == '/' && p + 1 < end && p[1] == '/') {
+      return 1;
+    } else if (*p == '/' && p + 1 < end && p[1] == '*') {
+      has_comment = 1;
+      *in_block = 1;
+      p++;
     }
   }
-  return 0;
+  return has_comment;
 }
 
-int is_comment_line(const char *line) {
-  while (*line == ' ' || *line == '\t')
-    line++;
-  return strncmp(line, "//", 2) == 0;
+/* Called for each commented line with its 1-based number in the scan and
+ * its bytes, newline included when there is one. */
+typedef void (*comment_line_fn)(long line_no, const char *start,
+                                const char *end);
+
+typedef struct {
+  uint64_t newlines;
+  uint64_t dquotes;
+  uint64_t squotes;
+  uint64_t backslashes;
+  uint64_t slashes;
+  uint64_t stars;
+} BlockMasks;
+
+#if defined(__AVX2__)
+const char *scan_kernel_name = "AVX2";
+
+uint64_t eq_mask(__m256i lo, __m256i hi, char c) {
+  __m256i needle = _mm256_set1_epi8(c);
+  uint64_t l = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle));
+  uint64_t h = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle));
+  return l | h << 32;
 }
 
-int line_contains_keyword(const char *line, const char *keyword) {
-  char *line_copy = strdup(line);
-  if (!line_copy) error("strdup failed in line_contains_keyword");
+void classify_block(const char *p, BlockMasks *m) {
+  __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+  m->newlines = eq_mask(lo, hi, '\n');
+  m->dquotes = eq_mask(lo, hi, '"');
+  m->squotes = eq_mask(lo, hi, '\'');
+  m->backslashes = eq_mask(lo, hi, '\\');
+  m->slashes = eq_mask(lo, hi, '/');
+  m->stars = eq_mask(lo, hi, '*');
+}
+#elif defined(__SSE2__)
+const char *scan_kernel_name = "SSE2";
 
-  char *token = strtok(line_copy, token_delimiters);
-  while (token != NULL) {
-    if (strcmp(token, keyword) == 0) {
-      free(line_copy);
-      return 1;
+uint64_t eq_mask(const __m128i v[4], char c) {
+  __m128i needle = _mm_set1_epi8(c);
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i)
+    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v[i], needle))
+            << (16 * i);
+  return mask;
+}
+
+void classify_block(const char *p, BlockMasks *m) {
+  __m128i v[4];
+  for (int i = 0; i < 4; ++i)
+    v[i] = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+  m->newlines = eq_mask(v, '\n');
+  m->dquotes = eq_mask(v, '"');
+  m->squotes = eq_mask(v, '\'');
+  m->backslashes = eq_mask(v, '\\');
+  m->slashes = eq_mask(v, '/');
+  m->stars = eq_mask(v, '*');
+}
+#else
+const char *scan_kernel_name = "scalar";
+
+void classify_block(const char *p, BlockMasks *m) {
+  memset(m, 0, sizeof(BlockMasks));
+  for (int i = 0; i < SCAN_BLOCK; ++i) {
+    uint64_t bit = (uint64_t)1 << i;
+    switch (p[i]) {
+      case '\n': m->newlines |= bit; break;
+      case '"': m->dquotes |= bit; break;
+      case '\'': m->squotes |= bit; break;
+      case '\\': m->backslashes |= bit; break;
+      case '/': m->slashes |= bit; break;
+      case '*': m->stars |= bit; break;
     }
-    token = strtok(NULL, token_delimiters);
   }
-  free(line_copy);
-  return 0;
 }
+#endif
+
+/* Same rules as scan_comment_line over a whole buffer, 64 bytes at a time.
+ * Blocks with none of " ' \ / * outside a block comment only need a
+ * popcount; otherwise the set bits are walked in order, so the state is
+ * only touched at the few interesting positions. result carries the line
+ * count and block comment state between calls on consecutive buffers that
+ * split at line ends. */
+void scan_text(const char *buf, size_t len, ScanResult *result,
+               comment_line_fn on_comment) {
+  int in_block = result->in_block;
+  char quote = 0;
+  int in_line_comment = 0;
+  int has_comment = 0;
+  size_t line_start = 0;
+  size_t skip = (size_t)-1;
+  char tail[SCAN_BLOCK];
+
+  for (size_t base = 0; base < len; base += SCAN_BLOCK) {
+    const char *p = buf + base;
+    if (len - base < SCAN_BLOCK) {
+      memset(tail, 0, SCAN_BLOCK);
+      memcpy(tail, p, len - base);
+      p = tail;
+    }
+
+    BlockMasks m;
+    classify_block(p, &m);
+    uint64_t specials =
+        m.dquotes | m.squotes | m.backslashes | m.slashes | m.stars;
+
+    if (!specials && !in_block) {
+      if (m.newlines) {
+        if (has_comment && on_comment)
+          on_comment(result->lines + 1, buf + line_start,
+                     buf + base + __builtin_ctzll(m.newlines) + 1);
+        result->lines += __builtin_popcountll(m.newlines);
+        result->comment_lines += has_comment;
+        has_comment = in_line_comment = quote = 0;
+        line_start = base + 64 - __builtin_clzll(m.newlines);
+      }
+      continue;
+    }
+
+    uint64_t events = m.newlines | specials;
+    while (events) {
+      int bit = __builtin_ctzll(events);
+      uint64_t mask = (uint64_t)1 << bit;
+      size_t pos = base + bit;
+      events &= events - 1;
+      char next = pos + 1 < len ? buf[pos + 1] : 0;
+
+      if (m.newlines & mask) {
+        result->lines++;
+        has_comment |= in_block && pos > line_start;
+        result->comment_lines += has_comment;
+        if (has_comment && on_comment)
+          on_comment(result->lines, buf + line_start, buf + pos + 1);
+        has_comment = in_line_comment = quote = 0;
+        line_start = pos + 1;
+      } else if (pos == skip || in_line_comment) {
+        continue;
+      } else if (in_block) {
+        if ((m.stars & mask) && next == '/') {
+          has_comment = 1;
+          in_block = 0;
+          skip = pos + 1;
+        }
+      } else if (quote) {
+        if (m.backslashes & mask)
+          skip = pos + 1;
+        else if ((m.dquotes & mask) ? quote == '"'
+                                    : (m.squotes & mask) && quote == '\'')
+          quote = 0;
+      } else if (m.dquotes & mask) {
+        quote = '"';
+      } else if (m.squotes & mask) {
+        quote = '\'';
+      } else if ((m.slashes & mask) && next == '/') {
+        has_comment = in_line_comment = 1;
+      } else if ((m.slashes & mask) && next == '*') {
+        has_comment = in_block = 1;
+        skip = pos + 1;
+      }
+    }
+  }
+
+  if (len > 0 && buf[len - 1] != '\n') {
+    result->lines++;
+    has_comment |= in_block && len > line_start;
+    result->comment_lines += has_comment;
+    if (has_comment && on_comment)
+      on_comment(result->lines, buf + line_start, buf + len);
+  }
+  result->in_block = in_block;
+}
+
+uint32_t hash_token(const char *token, size_t len, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)token[i];
+    h *= 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+/* Searches for a seed under which every keyword lands in its own slot, so a
+ * lookup is one hash, one probe and one memcmp. */
+void build_keyword_table(void) {
+  for (const char *d = token_delimiters; *d; ++d)
+    is_delimiter[(unsigned char)*d] = 1;
+  is_delimiter[0] = 1;
+
+  uint32_t size = 1;
+  while (size < 2u * (uint32_t)n_keywords)
+    size <<= 1;
 
-void *consumer_lines(void *_) {
   while (1) {
-    pthread_barrier_wait(&barrier_start);
+    keyword_table = realloc(keyword_table, size * sizeof(int));
+    if (!keyword_table)
+      error("realloc keyword_table");
 
-    pthread_mutex_lock(&buffer_mutex);
-    if (terminated) {
-      pthread_mutex_unlock(&buffer_mutex);
-      pthread_barrier_wait(&barrier_end);
-      break;
+    for (uint32_t seed = 0; seed < MAX_HASH_SEEDS; ++seed) {
+      int collision = 0;
+      for (uint32_t i = 0; i < size; ++i)
+        keyword_table[i] = -1;
+      for (int k = 0; k < n_keywords && !collision; ++k) {
+        uint32_t slot =
+            hash_token(keywords[k], keyword_lengths[k], seed) & (size - 1);
+        if (keyword_table[slot] != -1)
+          collision = 1;
+        else
+          keyword_table[slot] = k;
+      }
+      if (!collision) {
+        keyword_table_mask = size - 1;
+        keyword_hash_seed = seed;
+        return;
+      }
     }
+    size <<= 1;
+  }
+}
 
-    for (int i = 0; i < lines_in_buffer; ++i) {
-      printf("[Líneas]  Línea %d: %s", current_line + i + 1, buffer_lines[i]);
-      total_lines++;
+int lookup_keyword(const char *token, size_t len) {
+  int k = keyword_table[hash_token(token, len, keyword_hash_seed) &
+                        keyword_table_mask];
+  if (k >= 0 && keyword_lengths[k] == len &&
+      memcmp(keywords[k], token, len) == 0)
+    return k;
+  return -1;
+}
+
+void set_keywords(const char *list) {
+  n_keywords = 0;
+  if (!list) {
+    for (size_t i = 0; i < sizeof(default_keywords) / sizeof(default_keywords[0]); ++i)
+      keywords[n_keywords++] = default_keywords[i];
+  } else {
+    char *copy = strdup(list);
+    if (!copy)
+      error("strdup failed in set_keywords");
+    char *saveptr = NULL;
+    for (char *kw = strtok_r(copy, ",", &saveptr); kw;
+         kw = strtok_r(NULL, ",", &saveptr)) {
+      if (n_keywords == MAX_KEYWORDS)
+        error("too many keywords");
+      int duplicate = 0;
+      for (int k = 0; k < n_keywords; ++k)
+        if (strcmp(keywords[k], kw) == 0)
+          duplicate = 1;
+      if (!duplicate)
+        keywords[n_keywords++] = kw;
     }
+  }
+  if (n_keywords == 0)
+    error("empty keyword list");
+
+  for (int k = 0; k < n_keywords; ++k)
+    keyword_lengths[k] = strlen(keywords[k]);
+  build_keyword_table();
+}
+
+/* Single tokenizing pass over [p, end); returns a bitmask of the keywords
+ * found on the line. */
+uint64_t line_keywords_range(const char *p, const char *end) {
+  uint64_t found = 0;
 
-    pthread_mutex_unlock(&buffer_mutex);
-    pthread_barrier_wait(&barrier_end);
+  while (p < end) {
+    while (p < end && is_delimiter[(unsigned char)*p])
+      p++;
+    const char *token = p;
+    while (p < end && !is_delimiter[(unsigned char)*p])
+      p++;
+    if (p > token) {
+      int k = lookup_keyword(token, p - token);
+      if (k >= 0)
+        found |= (uint64_t)1 << k;
+    }
   }
-  return NULL;
+  return found;
 }
 
-void *consumer_comments(void *_) {
+/* Each consumer advances its own cursor through the ring; the reader only
+ * reuses a slot once the slowest cursor has moved past it. */
+void consume_ring(int consumer_id,
+                  void (*analyze)(const LineBatch *batch,
+                                  ConsumerStats *stats)) {
+  ConsumerStats stats;
+  memset(&stats, 0, sizeof(stats));
+  long cursor = 0;
+
   while (1) {
-    pthread_barrier_wait(&barrier_start);
+    long available = atomic_load_explicit(&write_cursor, memory_order_acquire);
+    if (cursor == available) {
+      if (atomic_load_explicit(&reader_done, memory_order_acquire) &&
+          cursor == atomic_load_explicit(&write_cursor, memory_order_acquire))
+        break;
+      sched_yield();
+      continue;
+    }
 
-    pthread_mutex_lock(&buffer_mutex);
-    if (terminated) {
-      pthread_mutex_unlock(&buffer_mutex);
-      pthread_barrier_wait(&barrier_end);
-      break;
+    struct timespec t_start, t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    for (; cursor < available; ++cursor) {
+      analyze(&ring[cursor % RING_SLOTS], &stats);
+      atomic_store_explicit(&read_cursors[consumer_id], cursor + 1,
+                            memory_order_release);
     }
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    stats.busy_seconds += (t_end.tv_sec - t_start.tv_sec) +
+                          (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+  }
 
-    for (int i = 0; i < lines_in_buffer; ++i) {
-      if (is_comment_line(buffer_lines[i]) ||
-          has_comment_inline(buffer_lines[i])) {
-        printf("[Comentario]  Linea: %d: %s", current_line + i + 1,
-               buffer_lines[i]);
-        total_comments++;
-      }
+  consumer_stats[consumer_id] = stats;
+}
+
+long slowest_reader(void) {
+  long slowest = atomic_load_explicit(&read_cursors[0], memory_order_acquire);
+  for (int c = 1; c < N_CONSUMERS; ++c) {
+    long cursor = atomic_load_explicit(&read_cursors[c], memory_order_acquire);
+    if (cursor < slowest)
+      slowest = cursor;
+  }
+  return slowest;
+}
+
+void analyze_lines(const LineBatch *batch, ConsumerStats *stats) {
+  const char *p = batch->data, *end = batch->data + batch->len;
+  while (p < end) {
+    const char *nl = memchr(p, '\n', end - p);
+    const char *next = nl ? nl + 1 : end;
+    stats->count++;
+    if (output_format == OUTPUT_TEXT) {
+      printf("[Líneas]  Línea %ld: ", stats->count);
+      fwrite(p, 1, next - p, stdout);
     }
+    p = next;
+  }
+}
+
+void print_comment_line(long line_no, const char *start, const char *end) {
+  printf("[Comentario]  Linea: %ld: ", line_no);
+  fwrite(start, 1, end - start, stdout);
+}
+
+/* One scan_text call per batch; the scan state lives in stats between
+ * batches, so block comments carry over like in tree mode. */
+void analyze_comments(const LineBatch *batch, ConsumerStats *stats) {
+  scan_text(batch->data, batch->len, &stats->scan,
+            output_format == OUTPUT_TEXT ? print_comment_line : NULL);
+  stats->count = stats->scan.comment_lines;
+}
 
-    pthread_mutex_unlock(&buffer_mutex);
-    pthread_barrier_wait(&barrier_end);
+void analyze_keywords(const LineBatch *batch, ConsumerStats *stats) {
+  const char *p = batch->data, *end = batch->data + batch->len;
+  while (p < end) {
+    const char *nl = memchr(p, '\n', end - p);
+    const char *eol = nl ? nl : end;
+    stats->lines++;
+    uint64_t found = line_keywords_range(p, eol);
+    for (int k = 0; found && k < n_keywords; ++k) {
+      if (found & ((uint64_t)1 << k)) {
+        if (output_format == OUTPUT_TEXT)
+          printf("[Palabras Clave] Linea %ld contiene '%s'\n", stats->lines,
+                 keywords[k]);
+        stats->keyword_counts[k]++;
+        stats->count++;
+      }
+    }
+    p = nl ? nl + 1 : end;
   }
+}
+
+void *consumer_lines(void *_) {
+  consume_ring(0, analyze_lines);
+  return NULL;
+}
+
+void *consumer_comments(void *_) {
+  consume_ring(1, analyze_comments);
   return NULL;
 }
 
 void *consumer_keywords(void *_) {
+  consume_ring(2, analyze_keywords);
+  return NULL;
+}
+
+void print_json_string(const char *str) {
+  putchar('"');
+  for (const unsigned char *p = (const unsigned char *)str; *p; ++p) {
+    if (*p == '"' || *p == '\\')
+      printf("\\%c", *p);
+    else if (*p < 0x20)
+      printf("\\u%04x", *p);
+    else
+      putchar(*p);
+  }
+  putchar('"');
+}
+
+void print_json_keywords(const long *counts) {
+  putchar('{');
+  for (int k = 0; k < n_keywords; ++k) {
+    printf(k ? ", " : "");
+    print_json_string(keywords[k]);
+    printf(": %ld", counts[k]);
+  }
+  putchar('}');
+}
+
+void print_csv_field(const char *str) {
+  if (!strpbrk(str, ",\"\n")) {
+    fputs(str, stdout);
+    return;
+  }
+  putchar('"');
+  for (const char *p = str; *p; ++p) {
+    if (*p == '"')
+      putchar('"');
+    putchar(*p);
+  }
+  putchar('"');
+}
+
+/* Machine-readable aggregates for --format=json|csv. CSV has two tables, per
+ * file rows plus a TOTAL row, then the stage timings, split by a blank line. */
+void emit_report(const FileReport *files, int n_files, const StageTiming *stages,
+                 int n_stages, const CacheStats *cache) {
+  long total_lines = 0;
+  long total_comments = 0;
+  long total_keywords[MAX_KEYWORDS] = {0};
+  for (int i = 0; i < n_files; ++i) {
+    total_lines += files[i].lines;
+    total_comments += files[i].comment_lines;
+    for (int k = 0; k < n_keywords; ++k)
+      total_keywords[k] += files[i].keyword_counts[k];
+  }
+
+  if (output_format == OUTPUT_JSON) {
+    printf("{\n  \"files\": [");
+    for (int i = 0; i < n_files; ++i) {
+      printf(i ? ",\n    {\"path\": " : "\n    {\"path\": ");
+      print_json_string(files[i].path);
+      printf(", \"lines\": %ld, \"comment_lines\": %ld, \"keywords\": ",
+             files[i].lines, files[i].comment_lines);
+      print_json_keywords(files[i].keyword_counts);
+      putchar('}');
+    }
+    printf("\n  ],\n  \"totals\": {\"files\": %d, \"lines\": %ld, "
+           "\"comment_lines\": %ld, \"keywords\": ",
+           n_files, total_lines, total_comments);
+    print_json_keywords(total_keywords);
+    printf("},\n  \"stages\": [");
+    for (int s = 0; s < n_stages; ++s) {
+      double secs = stages[s].seconds;
+      printf("%s\n    {\"name\": \"%s\", \"seconds\": %.6f, "
+             "\"lines_per_sec\": %.0f, \"bytes_per_sec\": %.0f}",
+             s ? "," : "", stages[s].name, secs,
+             secs > 0 ? stages[s].lines / secs : 0.0,
+             secs > 0 ? stages[s].bytes / secs : 0.0);
+    }
+    printf("\n  ]");
+    if (cache)
+      printf(",\n  \"cache\": {\"hits\": %ld, \"revalidated\": %ld, "
+             "\"misses\": %ld, \"dropped\": %ld, \"load_seconds\": %.6f, "
+             "\"save_seconds\": %.6f}",
+             cache->hits, cache->revalidated, cache->misses, cache->dropped,
+             cache->load_seconds, cache->save_seconds);
+    printf("\n}\n");
+    return;
+  }
+
+  printf("path,lines,comment_lines");
+  for (int k = 0; k < n_keywords; ++k) {
+    putchar(',');
+    print_csv_field(keywords[k]);
+  }
+  putchar('\n');
+  for (int i = 0; i < n_files; ++i) {
+    print_csv_field(files[i].path);
+    printf(",%ld,%ld", files[i].lines, files[i].comment_lines);
+    for (int k = 0; k < n_keywords; ++k)
+      printf(",%ld", files[i].keyword_counts[k]);
+    putchar('\n');
+  }
+  printf("TOTAL,%ld,%ld", total_lines, total_comments);
+  for (int k = 0; k < n_keywords; ++k)
+    printf(",%ld", total_keywords[k]);
+  printf("\n\nstage,seconds,lines_per_sec,bytes_per_sec\n");
+  for (int s = 0; s < n_stages; ++s) {
+    double secs = stages[s].seconds;
+    printf("%s,%.6f,%.0f,%.0f\n", stages[s].name, secs,
+           secs > 0 ? stages[s].lines / secs : 0.0,
+           secs > 0 ? stages[s].bytes / secs : 0.0);
+  }
+  if (cache)
+    printf("\ncache_hits,cache_revalidated,cache_misses,cache_dropped\n"
+           "%ld,%ld,%ld,%ld\n",
+           cache->hits, cache->revalidated, cache->misses, cache->dropped);
+}
+
+typedef struct {
+  char *path;
+  off_t size;
+  int64_t mtime_ns;
+  uint64_t hash;
+  long lines;
+  long comment_lines;
+  long *keyword_counts;
+} CacheEntry;
+
+typedef struct {
+  char *path;
+  const char *map;
+  off_t size;
+  int64_t mtime_ns;
+  int first_chunk;
+  int n_chunks;
+  CacheEntry *cached;
+  int from_cache;
+  int failed;
+  uint64_t hash;
+} SourceFile;
+
+/* Comment counts and exit block-comment state for both possible entry
+ * states, so chunks can be scanned before the previous one is done. */
+typedef struct {
+  int file;
+  off_t start;
+  off_t end;
+  int lines;
+  int comments[2];
+  int exit_state[2];
+  uint64_t hash;
+  int *keyword_counts;
+} Chunk;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  int *tasks;
+  int head;
+  int tail;
+} WorkDeque;
+
+typedef struct {
+  int thread_id;
+  int n_threads;
+  long bytes;
+  long lines;
+  int chunks;
+  int stolen;
+} TreeWorkerArgs;
+
+SourceFile *source_files;
+int n_source_files;
+int source_files_cap;
+Chunk *chunks;
+int n_chunks;
+int *chunk_keyword_counts;
+WorkDeque *deques;
+
+CacheEntry *cache_entries;
+int n_cache_entries;
+int *cache_index;
+uint32_t cache_index_mask;
+
+void add_source_file(const char *path, const struct stat *st) {
+  if (n_source_files == source_files_cap) {
+    source_files_cap = source_files_cap ? 2 * source_files_cap : 256;
+    source_files = realloc(source_files, source_files_cap * sizeof(SourceFile));
+    if (!source_files)
+      error("realloc source_files");
+  }
+  SourceFile *f = &source_files[n_source_files++];
+  f->path = strdup(path);
+  if (!f->path)
+    error("strdup failed in add_source_file");
+  f->map = NULL;
+  f->size = st->st_size;
+  f->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+  f->cached = NULL;
+  f->from_cache = 0;
+  f->failed = 0;
+  f->hash = 0;
+}
+
+int collect_file(const char *path, const struct stat *st, int type,
+                 struct FTW *ftwbuf) {
+  (void)ftwbuf;
+  if (type == FTW_F && S_ISREG(st->st_mode))
+    add_source_file(path, st);
+  return 0;
+}
+
+void collect_sources(const char *root) {
+  if (root[0] == '@') {
+    FILE *list = fopen(root + 1, "r");
+    if (!list)
+      error("error opening file list");
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, list)) != -1) {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+      struct stat st;
+      if (len > 0 && stat(line, &st) == 0 && S_ISREG(st.st_mode))
+        add_source_file(line, &st);
+    }
+    free(line);
+    fclose(list);
+    return;
+  }
+
+  struct stat st;
+  if (stat(root, &st) != 0)
+    error("error stat tree root");
+  if (S_ISREG(st.st_mode))
+    add_source_file(root, &st);
+  else if (nftw(root, collect_file, 64, FTW_PHYS) != 0)
+    error("error walking tree");
+}
+
+const char *map_file(const char *path, off_t size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+  madvise(map, size, MADV_SEQUENTIAL);
+  return map;
+}
+
+/* Moves a nominal offset to the start of the line it falls in the middle of,
+ * so neighbouring chunks agree on the boundary without coordination. */
+off_t align_to_line(const char *map, off_t size, off_t offset) {
+  if (offset <= 0)
+    return 0;
+  if (offset >= size)
+    return size;
+  if (map[offset - 1] == '\n')
+    return offset;
+  const char *nl = memchr(map + offset, '\n', size - offset);
+  return nl ? (nl - map) + 1 : size;
+}
+
+uint64_t hash_content(const char *p, size_t len) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/* A chunk that starts mid-file does not know whether it starts inside a
+ * block comment, so both entry states are scanned line by line until they
+ * agree; the rest of the chunk then goes through scan_text once. */
+void analyze_chunk(Chunk *chunk) {
+  SourceFile *f = &source_files[chunk->file];
+  const char *map = f->map;
+  int converged = chunk->start == 0;
+  int state[2] = {0, 1};
+
+  chunk->lines = 0;
+  chunk->comments[0] = chunk->comments[1] = 0;
+
+  const char *start = map + chunk->start;
+  const char *end = map + chunk->end;
+  chunk->hash = hash_content(start, end - start);
+
+  const char *p = start;
+  while (p < end && !converged) {
+    const char *nl = memchr(p, '\n', end - p);
+    const char *eol = nl ? nl : end;
+    chunk->lines++;
+    chunk->comments[0] += scan_comment_line(p, eol, &state[0]);
+    chunk->comments[1] += scan_comment_line(p, eol, &state[1]);
+    converged = state[0] == state[1];
+    p = nl ? nl + 1 : end;
+  }
+
+  ScanResult scan = {0, 0, state[0]};
+  scan_text(p, end - p, &scan, NULL);
+  chunk->lines += scan.lines;
+  chunk->comments[0] += scan.comment_lines;
+  chunk->comments[1] += scan.comment_lines;
+  chunk->exit_state[0] = scan.in_block;
+  chunk->exit_state[1] = converged ? scan.in_block : state[1];
+
+  for (p = start; p < end;) {
+    const char *nl = memchr(p, '\n', end - p);
+    const char *eol = nl ? nl : end;
+    uint64_t found = line_keywords_range(p, eol);
+    for (int k = 0; found && k < n_keywords; ++k)
+      if (found & ((uint64_t)1 << k))
+        chunk->keyword_counts[k]++;
+    p = nl ? nl + 1 : end;
+  }
+}
+
+void process_chunk(Chunk *chunk) {
+  SourceFile *f = &source_files[chunk->file];
+
+  if (f->n_chunks == 1) {
+    if (f->size == 0)
+      return;
+    f->map = map_file(f->path, f->size);
+    if (!f->map) {
+      fprintf(stderr, "skipping %s: cannot map\n", f->path);
+      f->failed = 1;
+      chunk->end = 0;
+      return;
+    }
+    if (f->cached && hash_content(f->map, f->size) == f->cached->hash)
+      f->from_cache = 1;
+    else
+      analyze_chunk(chunk);
+    munmap((void *)f->map, f->size);
+    f->map = NULL;
+  } else if (f->map) {
+    analyze_chunk(chunk);
+  }
+}
+
+int deque_pop(WorkDeque *d) {
+  int task = -1;
+  pthread_mutex_lock(&d->mutex);
+  if (d->tail > d->head)
+    task = d->tasks[--d->tail];
+  pthread_mutex_unlock(&d->mutex);
+  return task;
+}
+
+int deque_steal(WorkDeque *d) {
+  int task = -1;
+  pthread_mutex_lock(&d->mutex);
+  if (d->tail > d->head)
+    task = d->tasks[d->head++];
+  pthread_mutex_unlock(&d->mutex);
+  return task;
+}
+
+/* Owners pop their own chunks from the tail; idle workers steal from the
+ * head of the other deques. No chunks are added once workers start, so an
+ * empty sweep over every deque means the run is finished. */
+void *tree_worker(void *arg) {
+  TreeWorkerArgs *args = (TreeWorkerArgs *)arg;
+  WorkDeque *own = &deques[args->thread_id];
+
   while (1) {
-    pthread_barrier_wait(&barrier_start);
+    int c = deque_pop(own);
+    if (c < 0) {
+      for (int v = 1; v < args->n_threads && c < 0; ++v)
+        c = deque_steal(&deques[(args->thread_id + v) % args->n_threads]);
+      if (c < 0)
+        break;
+      args->stolen++;
+    }
+    process_chunk(&chunks[c]);
+    args->bytes += chunks[c].end - chunks[c].start;
+    args->lines += chunks[c].lines;
+    args->chunks++;
+  }
+  return NULL;
+}
+
+void split_into_chunks(void) {
+  n_chunks = 0;
+  for (int i = 0; i < n_source_files; ++i) {
+    SourceFile *f = &source_files[i];
+    f->first_chunk = n_chunks;
+    if (f->from_cache)
+      f->n_chunks = 0;
+    else
+      f->n_chunks = f->size > CHUNK_BYTES ? (f->size + CHUNK_BYTES - 1) / CHUNK_BYTES : 1;
+    n_chunks += f->n_chunks;
+  }
 
-    pthread_mutex_lock(&buffer_mutex);
-    if (terminated) {
-      pthread_mutex_unlock(&buffer_mutex);
-      pthread_barrier_wait(&barrier_end);
-      break;
+  chunks = calloc(n_chunks > 0 ? n_chunks : 1, sizeof(Chunk));
+  chunk_keyword_counts = calloc((size_t)(n_chunks > 0 ? n_chunks : 1) * n_keywords, sizeof(int));
+  if (!chunks || !chunk_keyword_counts)
+    error("calloc chunks");
+
+  for (int i = 0; i < n_source_files; ++i) {
+    SourceFile *f = &source_files[i];
+    if (f->n_chunks > 1) {
+      f->map = map_file(f->path, f->size);
+      if (!f->map) {
+        fprintf(stderr, "skipping %s: cannot map\n", f->path);
+        f->failed = 1;
+      }
+    }
+    for (int j = 0; j < f->n_chunks; ++j) {
+      Chunk *chunk = &chunks[f->first_chunk + j];
+      chunk->file = i;
+      chunk->keyword_counts = chunk_keyword_counts + (size_t)(f->first_chunk + j) * n_keywords;
+      if (f->n_chunks == 1) {
+        chunk->start = 0;
+        chunk->end = f->size;
+      } else if (f->map) {
+        chunk->start = align_to_line(f->map, f->size, (off_t)j * CHUNK_BYTES);
+        chunk->end = align_to_line(f->map, f->size, (off_t)(j + 1) * CHUNK_BYTES);
+      }
     }
+  }
+}
 
-    for (int i = 0; i < lines_in_buffer; ++i) {
-      for (int k = 0; k < n_keywords; ++k) {
-        if (line_contains_keyword(buffer_lines[i], keywords[k])) {
-          printf("[Palabras Clave] Linea %d contiene '%s'\n",
-                 current_line + i + 1, keywords[k]);
-          total_keywords++;
-        }
+uint32_t hash_path(const char *path) {
+  return (uint32_t)hash_content(path, strlen(path));
+}
+
+CacheEntry *cache_lookup(const char *path) {
+  if (!cache_index)
+    return NULL;
+  for (uint32_t slot = hash_path(path) & cache_index_mask;;
+       slot = (slot + 1) & cache_index_mask) {
+    int e = cache_index[slot];
+    if (e < 0)
+      return NULL;
+    if (strcmp(cache_entries[e].path, path) == 0)
+      return &cache_entries[e];
+  }
+}
+
+void keyword_signature(char *out, size_t cap) {
+  size_t used = 0;
+  out[0] = '\0';
+  for (int k = 0; k < n_keywords && used < cap; ++k)
+    used += snprintf(out + used, cap - used, k ? ",%s" : "%s", keywords[k]);
+}
+
+/* One line per file: size, mtime in ns, content hash, lines, comment lines,
+ * the per-keyword counts and finally the path, which may contain spaces. The
+ * header carries the keyword list; a different list discards the cache. */
+void load_cache(const char *cache_path) {
+  FILE *file = fopen(cache_path, "r");
+  if (!file)
+    return;
+
+  char signature[4096];
+  keyword_signature(signature, sizeof(signature));
+
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len = getline(&line, &cap, file);
+  size_t magic_len = strlen(CACHE_MAGIC);
+  if (len <= 0 || strncmp(line, CACHE_MAGIC " ", magic_len + 1) != 0 ||
+      strcspn(line + magic_len + 1, "\n") != strlen(signature) ||
+      strncmp(line + magic_len + 1, signature, strlen(signature)) != 0) {
+    free(line);
+    fclose(file);
+    return;
+  }
+
+  int entries_cap = 0;
+  while ((len = getline(&line, &cap, file)) != -1) {
+    if (len > 0 && line[len - 1] == '\n')
+      line[--len] = '\0';
+
+    if (n_cache_entries == entries_cap) {
+      entries_cap = entries_cap ? 2 * entries_cap : 1024;
+      cache_entries = realloc(cache_entries, entries_cap * sizeof(CacheEntry));
+      if (!cache_entries)
+        error("realloc cache_entries");
+    }
+    CacheEntry *e = &cache_entries[n_cache_entries];
+    e->keyword_counts = malloc(n_keywords * sizeof(long));
+    if (!e->keyword_counts)
+      error("malloc cache keyword counts");
+
+    char *p = line;
+    e->size = strtoll(p, &p, 10);
+    e->mtime_ns = strtoll(p, &p, 10);
+    e->hash = strtoull(p, &p, 16);
+    e->lines = strtol(p, &p, 10);
+    e->comment_lines = strtol(p, &p, 10);
+    for (int k = 0; k < n_keywords; ++k)
+      e->keyword_counts[k] = strtol(p, &p, 10);
+    if (*p != ' ') {
+      free(e->keyword_counts);
+      continue;
+    }
+    e->path = strdup(p + 1);
+    if (!e->path)
+      error("strdup cache path");
+    n_cache_entries++;
+  }
+  free(line);
+  fclose(file);
+
+  uint32_t size = 1;
+  while (size < 2u * (uint32_t)n_cache_entries)
+    size <<= 1;
+  cache_index = malloc(size * sizeof(int));
+  if (!cache_index)
+    error("malloc cache_index");
+  cache_index_mask = size - 1;
+  for (uint32_t i = 0; i < size; ++i)
+    cache_index[i] = -1;
+  for (int e = 0; e < n_cache_entries; ++e) {
+    uint32_t slot = hash_path(cache_entries[e].path) & cache_index_mask;
+    while (cache_index[slot] >= 0)
+      slot = (slot + 1) & cache_index_mask;
+    cache_index[slot] = e;
+  }
+}
+
+/* Files whose size and mtime match their entry are skipped outright; a size
+ * match with a new mtime is rehashed before deciding. */
+void match_cache(CacheStats *stats) {
+  long found = 0;
+  for (int i = 0; i < n_source_files; ++i) {
+    SourceFile *f = &source_files[i];
+    CacheEntry *e = cache_lookup(f->path);
+    if (e)
+      found++;
+    if (e && e->size == f->size) {
+      if (e->mtime_ns == f->mtime_ns) {
+        f->from_cache = 1;
+        stats->hits++;
       }
+      f->cached = e;
     }
+  }
+  stats->dropped = n_cache_entries - found;
+}
 
-    pthread_mutex_unlock(&buffer_mutex);
-    pthread_barrier_wait(&barrier_end);
+void save_cache(const char *cache_path, const FileReport *reports) {
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+  FILE *file = fopen(tmp_path, "w");
+  if (!file) {
+    perror("cannot write cache");
+    return;
   }
-  return NULL;
+
+  char signature[4096];
+  keyword_signature(signature, sizeof(signature));
+  fprintf(file, "%s %s\n", CACHE_MAGIC, signature);
+
+  for (int i = 0; i < n_source_files; ++i) {
+    const SourceFile *f = &source_files[i];
+    /* An unreadable file has no counts worth keeping; leaving it out makes
+     * the next run try it again instead of trusting its zeros. */
+    if (f->failed || strchr(f->path, '\n'))
+      continue;
+    fprintf(file, "%lld %lld %016llx %ld %ld", (long long)f->size,
+            (long long)f->mtime_ns, (unsigned long long)f->hash,
+            reports[i].lines, reports[i].comment_lines);
+    for (int k = 0; k < n_keywords; ++k)
+      fprintf(file, " %ld", reports[i].keyword_counts[k]);
+    fprintf(file, " %s\n", f->path);
+  }
+
+  if (fclose(file) != 0 || rename(tmp_path, cache_path) != 0)
+    perror("cannot write cache");
+}
+
+void free_cache(void) {
+  for (int e = 0; e < n_cache_entries; ++e) {
+    free(cache_entries[e].path);
+    free(cache_entries[e].keyword_counts);
+  }
+  free(cache_entries);
+  free(cache_index);
+}
+
+double seconds_since(struct timespec *mark) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double seconds = (now.tv_sec - mark->tv_sec) + (now.tv_nsec - mark->tv_nsec) / 1e9;
+  *mark = now;
+  return seconds;
+}
+
+int tree_main(const char *root, int n_threads, const char *cache_path) {
+  if (n_threads <= 0)
+    n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads <= 0)
+    n_threads = 1;
+
+  struct timespec mark;
+  clock_gettime(CLOCK_MONOTONIC, &mark);
+
+  collect_sources(root);
+  double discover_seconds = seconds_since(&mark);
+
+  CacheStats cache_stats = {0};
+  if (cache_path) {
+    load_cache(cache_path);
+    match_cache(&cache_stats);
+    cache_stats.load_seconds = seconds_since(&mark);
+  }
+
+  split_into_chunks();
+  double split_seconds = seconds_since(&mark);
+
+  deques = malloc(n_threads * sizeof(WorkDeque));
+  int *tasks = malloc((n_chunks > 0 ? n_chunks : 1) * sizeof(int));
+  if (!deques || !tasks)
+    error("malloc deques");
+  for (int c = 0; c < n_chunks; ++c)
+    tasks[c] = c;
+  for (int t = 0; t < n_threads; ++t) {
+    pthread_mutex_init(&deques[t].mutex, NULL);
+    deques[t].tasks = tasks;
+    blas1_range(n_chunks, n_threads, t, &deques[t].head, &deques[t].tail);
+  }
+
+  pthread_t threads[n_threads];
+  TreeWorkerArgs worker_args[n_threads];
+  for (int t = 0; t < n_threads; ++t) {
+    worker_args[t] = (TreeWorkerArgs){t, n_threads, 0, 0, 0, 0};
+    if (pthread_create(&threads[t], NULL, tree_worker, &worker_args[t]) != 0)
+      error("error pthread_create");
+  }
+
+  long bytes = 0;
+  long lines = 0;
+  int stolen = 0;
+  for (int t = 0; t < n_threads; ++t) {
+    pthread_join(threads[t], NULL);
+    bytes += worker_args[t].bytes;
+    lines += worker_args[t].lines;
+    stolen += worker_args[t].stolen;
+  }
+  double analyze_seconds = seconds_since(&mark);
+
+  FileReport *reports = malloc((n_source_files > 0 ? n_source_files : 1) * sizeof(FileReport));
+  long *file_keyword_counts =
+      calloc((size_t)(n_source_files > 0 ? n_source_files : 1) * n_keywords, sizeof(long));
+  if (!reports || !file_keyword_counts)
+    error("malloc reports");
+
+  long comments = 0;
+  long keyword_totals[MAX_KEYWORDS] = {0};
+  long keyword_sum = 0;
+  for (int i = 0; i < n_source_files; ++i) {
+    SourceFile *f = &source_files[i];
+    FileReport *report = &reports[i];
+    long *counts = file_keyword_counts + (size_t)i * n_keywords;
+    *report = (FileReport){f->path, 0, 0, counts};
+
+    if (f->from_cache) {
+      report->lines = f->cached->lines;
+      report->comment_lines = f->cached->comment_lines;
+      memcpy(counts, f->cached->keyword_counts, n_keywords * sizeof(long));
+      f->hash = f->cached->hash;
+      lines += report->lines;
+    } else {
+      cache_stats.misses++;
+    }
+
+    /* A revalidated file keeps its one chunk, left unanalyzed. */
+    int state = 0;
+    for (int j = 0; !f->from_cache && j < f->n_chunks; ++j) {
+      Chunk *chunk = &chunks[f->first_chunk + j];
+      report->lines += chunk->lines;
+      report->comment_lines += chunk->comments[state];
+      state = chunk->exit_state[state];
+      f->hash = f->n_chunks == 1 ? chunk->hash : f->hash * 1099511628211ull ^ chunk->hash;
+      for (int k = 0; k < n_keywords; ++k)
+        counts[k] += chunk->keyword_counts[k];
+    }
+    comments += report->comment_lines;
+    for (int k = 0; k < n_keywords; ++k)
+      keyword_totals[k] += counts[k];
+    if (f->map)
+      munmap((void *)f->map, f->size);
+  }
+  for (int k = 0; k < n_keywords; ++k)
+    keyword_sum += keyword_totals[k];
+  double merge_seconds = seconds_since(&mark);
+
+  if (cache_path) {
+    cache_stats.revalidated = n_source_files - cache_stats.misses - cache_stats.hits;
+    save_cache(cache_path, reports);
+    cache_stats.save_seconds = seconds_since(&mark);
+    free_cache();
+  }
+  double seconds = discover_seconds + cache_stats.load_seconds + split_seconds +
+                   analyze_seconds + merge_seconds;
+
+  if (output_format != OUTPUT_TEXT) {
+    StageTiming stages[] = {
+        {"discover", discover_seconds, lines, bytes},
+        {"split", split_seconds, lines, bytes},
+        {"analyze", analyze_seconds, lines, bytes},
+        {"merge", merge_seconds, lines, bytes},
+        {"total", seconds, lines, bytes},
+    };
+    emit_report(reports, n_source_files, stages, sizeof(stages) / sizeof(stages[0]),
+                cache_path ? &cache_stats : NULL);
+  } else {
+    println("\n ------- Resultados ------");
+    println("Archivos analizados:                     %d", n_source_files);
+    println("Fragmentos (robados):                    %d (%d)", n_chunks, stolen);
+    println("Conteo total de lineas:                  %ld", lines);
+    println("Conteo total de lineas con comentarios:  %ld", comments);
+    println("Conteo total de palabras clave:          %ld", keyword_sum);
+    for (int k = 0; k < n_keywords; ++k)
+      println("  %-10s %ld", keywords[k], keyword_totals[k]);
+    println("Lineas por segundo:                      %.0f",
+            seconds > 0 ? lines / seconds : 0.0);
+    println("Rendimiento:                             %.3f GB/s",
+            seconds > 0 ? bytes / seconds / 1e9 : 0.0);
+    if (cache_path)
+      println("Cache: %ld aciertos, %ld revalidados, %ld fallos, %ld descartados",
+              cache_stats.hits, cache_stats.revalidated, cache_stats.misses,
+              cache_stats.dropped);
+  }
+
+  for (int i = 0; i < n_source_files; ++i)
+    free(source_files[i].path);
+  for (int t = 0; t < n_threads; ++t)
+    pthread_mutex_destroy(&deques[t].mutex);
+  free(deques);
+  free(tasks);
+  free(chunks);
+  free(chunk_keyword_counts);
+  free(source_files);
+  free(reports);
+  free(file_keyword_counts);
+
+  return EXIT_SUCCESS;
+}
+
+/* Compares scan_comment_line one line at a time with scan_text over the same
+ * file held in memory, repeating until about 1 GB has been scanned. */
+int bench_scan_main(const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  if (!file)
+    error("error opening file");
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char *text = malloc(size + 1);
+  char *lines = malloc(size + 1);
+  if (!text || !lines)
+    error("malloc bench_scan");
+  if (fread(text, 1, size, file) != (size_t)size)
+    error("error reading file");
+  fclose(file);
+  text[size] = '\0';
+  for (long i = 0; i <= size; ++i)
+    lines[i] = text[i] == '\n' ? '\0' : text[i];
+
+  long repetitions = size > 0 ? BENCH_SCAN_BYTES / size : 1;
+  if (repetitions < 1)
+    repetitions = 1;
+
+  struct timespec t_start, t_end;
+  ScanResult scalar = {0, 0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  for (long r = 0; r < repetitions; ++r) {
+    scalar.lines = scalar.comment_lines = scalar.in_block = 0;
+    for (const char *p = lines; p < lines + size;) {
+      size_t len = strlen(p);
+      scalar.lines++;
+      scalar.comment_lines += scan_comment_line(p, p + len, &scalar.in_block);
+      p += len + 1;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double scalar_seconds = (t_end.tv_sec - t_start.tv_sec) +
+                          (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
+  ScanResult simd = {0, 0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  for (long r = 0; r < repetitions; ++r) {
+    simd.lines = simd.comment_lines = simd.in_block = 0;
+    scan_text(text, size, &simd, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double simd_seconds = (t_end.tv_sec - t_start.tv_sec) +
+                        (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
+  double gigabytes = (double)size * repetitions / 1e9;
+  println("Byte a byte:  %ld lineas, %ld comentarios, %.3f GB/s",
+          scalar.lines, scalar.comment_lines, gigabytes / scalar_seconds);
+  println("%-12s  %ld lineas, %ld comentarios, %.3f GB/s", scan_kernel_name,
+          simd.lines, simd.comment_lines, gigabytes / simd_seconds);
+
+  free(text);
+  free(lines);
+  return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2)
-    error("incorrect format usage");
+  const char *usage = "Usage: <file> | --tree <dir|@file_list> [--threads=N]"
+                      " [--keywords=kw1,kw2,...] [--format=text|json|csv]"
+                      " [--cache=path]"
+                      " | --bench-scan <file>";
+  const char *input = NULL;
+  const char *tree_root = NULL;
+  const char *keyword_list = NULL;
+  const char *cache_path = NULL;
+  int n_threads = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--keywords=", 11) == 0)
+      keyword_list = argv[i] + 11;
+    else if (strcmp(argv[i], "--format=text") == 0)
+      output_format = OUTPUT_TEXT;
+    else if (strcmp(argv[i], "--format=json") == 0)
+      output_format = OUTPUT_JSON;
+    else if (strcmp(argv[i], "--format=csv") == 0)
+      output_format = OUTPUT_CSV;
+    else if (strncmp(argv[i], "--cache=", 8) == 0)
+      cache_path = argv[i] + 8;
+    else if (strncmp(argv[i], "--threads=", 10) == 0)
+      n_threads = atoi(argv[i] + 10);
+    else if (strcmp(argv[i], "--tree") == 0 && i + 1 < argc)
+      tree_root = argv[++i];
+    else if (strcmp(argv[i], "--bench-scan") == 0 && i + 1 < argc)
+      return bench_scan_main(argv[++i]);
+    else if (!input && argv[i][0] != '-')
+      input = argv[i];
+    else
+      error(usage);
+  }
+  if (!input == !tree_root)
+    error(usage);
+
+  set_keywords(keyword_list);
 
-  FILE *file = fopen(argv[1], "r");
+  if (tree_root)
+    return tree_main(tree_root, n_threads, cache_path);
+
+  FILE *file = fopen(input, "r");
   if (!file)
     error("error opening file");
 
-  pthread_barrier_init(&barrier_start, NULL, 4);
-  pthread_barrier_init(&barrier_end, NULL, 4);
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
 
   pthread_t thread_lines, thread_comments, thread_keywords;
   pthread_create(&thread_lines, NULL, consumer_lines, NULL);
   pthread_create(&thread_comments, NULL, consumer_comments, NULL);
   pthread_create(&thread_keywords, NULL, consumer_keywords, NULL);
 
-  char *line = NULL;
-  size_t len = 0;
-  ssize_t read;
+  long cursor = 0;
+  long bytes_read = 0;
+  double read_seconds = 0.0;
+  int eof = 0;
+  char *carry = NULL;
+  size_t carry_len = 0, carry_cap = 0;
 
-  while (1) {
-    pthread_mutex_lock(&buffer_mutex);
-
-    lines_in_buffer = 0;
-    for (int i = 0; i < BUFFER_LINES; ++i) {
-      read = getline(&line, &len, file);
-      if (read != - 1) {
-        buffer_lines[i] = line;
-        line = NULL;
-        len = 0;
-        lines_in_buffer++;
-      } else {
-        break;
-      }
-    }
+  /* Each batch is the bytes left over from the previous read plus a fresh
+   * BATCH_BYTES, cut after its last newline; the cut-off tail is carried
+   * into the next batch. A batch without any newline keeps growing. */
+  while (!eof) {
+    while (cursor - slowest_reader() >= RING_SLOTS)
+      sched_yield();
 
-    if (lines_in_buffer == 0) {
-      terminated = 1;
-      pthread_mutex_unlock(&buffer_mutex);
-      pthread_barrier_wait(&barrier_start);
-      pthread_barrier_wait(&barrier_end);
-      break;
+    struct timespec r_start, r_end;
+    clock_gettime(CLOCK_MONOTONIC, &r_start);
+    LineBatch *batch = &ring[cursor % RING_SLOTS];
+    if (batch->cap < carry_len + BATCH_BYTES) {
+      batch->cap = carry_len + BATCH_BYTES;
+      batch->data = realloc(batch->data, batch->cap);
+      if (!batch->data)
+        error("realloc batch");
     }
-
-    pthread_mutex_unlock(&buffer_mutex);
-
-    pthread_barrier_wait(&barrier_start);
-    pthread_barrier_wait(&barrier_end);
-
-    for (int i = 0; i < lines_in_buffer; ++i) {
-      free(buffer_lines[i]);
+    if (carry_len)
+      memcpy(batch->data, carry, carry_len);
+    size_t n = fread(batch->data + carry_len, 1, BATCH_BYTES, file);
+    bytes_read += n;
+    batch->len = carry_len + n;
+    carry_len = 0;
+    if (n == 0) {
+      eof = 1;
+    } else {
+      const char *last = memrchr(batch->data, '\n', batch->len);
+      size_t keep = last ? (size_t)(last - batch->data) + 1 : 0;
+      carry_len = batch->len - keep;
+      if (carry_len > carry_cap) {
+        carry_cap = carry_len;
+        carry = realloc(carry, carry_cap);
+        if (!carry)
+          error("realloc carry");
+      }
+      memcpy(carry, batch->data + keep, carry_len);
+      batch->len = keep;
     }
+    clock_gettime(CLOCK_MONOTONIC, &r_end);
+    read_seconds += (r_end.tv_sec - r_start.tv_sec) +
+                    (r_end.tv_nsec - r_start.tv_nsec) / 1e9;
 
-    current_line += lines_in_buffer;
+    if (batch->len > 0)
+      atomic_store_explicit(&write_cursor, ++cursor, memory_order_release);
   }
+  free(carry);
+  atomic_store_explicit(&reader_done, 1, memory_order_release);
 
   pthread_join(thread_lines, NULL);
   pthread_join(thread_comments, NULL);
   pthread_join(thread_keywords, NULL);
 
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double seconds = (t_end.tv_sec - t_start.tv_sec) +
+                   (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
   fclose(file);
 
-  pthread_barrier_destroy(&barrier_start);
-  pthread_barrier_destroy(&barrier_end);
-  pthread_mutex_destroy(&buffer_mutex);
+  for (int s = 0; s < RING_SLOTS; ++s)
+    free(ring[s].data);
+
+  ConsumerStats *lines_stats = &consumer_stats[0];
+  ConsumerStats *comments_stats = &consumer_stats[1];
+  ConsumerStats *keywords_stats = &consumer_stats[2];
+  long current_line = lines_stats->count;
+
+  if (output_format != OUTPUT_TEXT) {
+    FileReport report = {input, lines_stats->count, comments_stats->count,
+                         keywords_stats->keyword_counts};
+    StageTiming stages[] = {
+        {"read", read_seconds, current_line, bytes_read},
+        {"lines", lines_stats->busy_seconds, current_line, bytes_read},
+        {"comments", comments_stats->busy_seconds, current_line, bytes_read},
+        {"keywords", keywords_stats->busy_seconds, current_line, bytes_read},
+        {"total", seconds, current_line, bytes_read},
+    };
+    emit_report(&report, 1, stages, sizeof(stages) / sizeof(stages[0]), NULL);
+    return EXIT_SUCCESS;
+  }
 
   println("\n ------- Resultados ------");
-  println("Conteo total de lineas:                  %d", total_lines);
-  println("Conteo total de lineas con comentarios:  %d", total_comments);
-  println("Conteo total de palabras clave:          %d", total_keywords);
+  println("Conteo total de lineas:                  %ld", lines_stats->count);
+  println("Conteo total de lineas con comentarios:  %ld", comments_stats->count);
+  println("Conteo total de palabras clave:          %ld", keywords_stats->count);
+  for (int k = 0; k < n_keywords; ++k)
+    println("  %-10s %ld", keywords[k], keywords_stats->keyword_counts[k]);
+  println("Lineas por segundo:                      %.0f",
+          seconds > 0 ? current_line / seconds : 0.0);
 
   return EXIT_SUCCESS;
 }
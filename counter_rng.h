@@ -0,0 +1,32 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+/* Stateless counter-based RNG: SplitMix64's output function applied to a
+ * (seed, generation) key plus a per-item counter. Any thread can draw item i
+ * of generation g without shared state, so results do not depend on how the
+ * work is split or scheduled, and loops over counters vectorize. */
+
+#include <stdint.h>
+
+#define CRNG_GOLDEN 0x9e3779b97f4a7c15ULL
+
+static inline uint64_t crng_mix(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static inline uint64_t crng_key(uint64_t seed, uint64_t generation) {
+  return crng_mix(seed ^ crng_mix(generation + CRNG_GOLDEN));
+}
+
+static inline uint64_t crng_u64(uint64_t key, uint64_t counter) {
+  return crng_mix(key + (counter + 1) * CRNG_GOLDEN);
+}
+
+/* Uniform double in [0, 1) with 53 random bits. */
+static inline double crng_uniform(uint64_t key, uint64_t counter) {
+  return (crng_u64(key, counter) >> 11) * 0x1.0p-53;
+}
+
+#endif
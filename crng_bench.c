@@ -0,0 +1,81 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "counter_rng.h"
+
+typedef struct {
+  int thread_id;
+  long draws;
+  double sum;
+} ThreadArgs;
+
+void error(const char *err) {
+  perror(err);
+  exit(EXIT_FAILURE);
+}
+
+void *draw_rand(void *arg) {
+  ThreadArgs *args = (ThreadArgs *)arg;
+  double sum = 0.0;
+  for (long i = 0; i < args->draws; ++i)
+    sum += (double)rand() / RAND_MAX;
+  args->sum = sum;
+  return NULL;
+}
+
+void *draw_crng(void *arg) {
+  ThreadArgs *args = (ThreadArgs *)arg;
+  uint64_t key = crng_key(42, 0);
+  uint64_t base = (uint64_t)args->thread_id * args->draws;
+  double sum = 0.0;
+  for (long i = 0; i < args->draws; ++i)
+    sum += crng_uniform(key, base + i);
+  args->sum = sum;
+  return NULL;
+}
+
+double run(void *(*fn)(void *), int n_threads, long draws) {
+  pthread_t threads[n_threads];
+  ThreadArgs thread_args[n_threads];
+  struct timespec t_start, t_end;
+
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  for (int i = 0; i < n_threads; ++i) {
+    thread_args[i] = (ThreadArgs){i, draws, 0.0};
+    if (pthread_create(&threads[i], NULL, fn, &thread_args[i]) != 0)
+      error("error pthread_create");
+  }
+  double sum = 0.0;
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+    sum += thread_args[i].sum;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+  double seconds = (t_end.tv_sec - t_start.tv_sec) +
+                   (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+  printf("  mean %.6f, %.1f M draws/s\n", sum / (n_threads * (double)draws),
+         n_threads * (double)draws / seconds / 1e6);
+  return seconds;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3)
+    error("Usage: <n_threads> <draws_per_thread>");
+
+  int n_threads = atoi(argv[1]);
+  long draws = atol(argv[2]);
+  if (n_threads <= 0 || draws <= 0)
+    error("arguments must be greater than 0");
+
+  printf("rand() shared state:\n");
+  double rand_seconds = run(draw_rand, n_threads, draws);
+  printf("counter-based crng:\n");
+  double crng_seconds = run(draw_crng, n_threads, draws);
+  printf("speedup: %.2fx\n", rand_seconds / crng_seconds);
+
+  return EXIT_SUCCESS;
+}
@@ -2,49 +2,116 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "blas1.h"
+#include "counter_rng.h"
 
 #define N_NEIGHBORS 8
 #define N_THREADS 2
+#define WORD_BITS 64
+#define TILE_ROWS 8
+#define DENSE_FRACTION 0.5
+#define CACHE_LINE 64
 
-int **matrix;
-int **temp_matrix;
-int **next_state_temp;
+/* Classic engine: one byte per cell in flat row-major buffers. State s lives
+ * in cells[s % 2]; shift s reads it and writes cells[(s + 1) % 2]. */
+uint8_t *cells[2];
 
 int matrix_rows_size;
 int matrix_cols_size;
 int shifts;
+uint64_t rng_seed;
 
 pthread_barrier_t barrier;
 
+/* Bit-plane grid: every cell keeps 2 bits, one in nonzero (state > 0) and
+ * one in two (state == 2), 64 cells per word and words_per_row per row. */
+typedef struct {
+  uint64_t *nonzero;
+  uint64_t *two;
+} PackedGrid;
+
+typedef struct {
+  int start_row;
+  int end_row;
+  int start_tile_row;
+  int end_tile_row;
+  long tiles_computed;
+} PackedArgs;
+
+PackedGrid packed[2];
+int words_per_row;
+uint64_t last_word_mask;
+
+/* Frontier bookkeeping: tiles are TILE_ROWS rows by one word. Flags for
+ * shift t live in index t % 2 and are written for index (t + 1) % 2. */
+int use_frontier = 0;
+int quiet = 0;
+int n_tile_rows;
+uint8_t *tile_changed[2];
+uint8_t *tile_has_ones[2];
+uint8_t *tile_active;
+
+typedef int (*cell_fn)(const void *grid, int x, int y);
+
+/* Output runs on its own thread so printing overlaps the next shift. A posted
+ * grid stays valid for one shift: the driver waits for the writer before
+ * releasing the shift that overwrites it. */
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int busy;
+  int done;
+  int shift;
+  const void *grid;
+  cell_fn cell;
+  FILE *binary;
+  uint8_t *row;
+} SnapshotWriter;
+
+int use_packed = 0;
+int print_every = 1;
+SnapshotWriter writer;
+
 void error(const char *err) {
   perror(err);
   exit(EXIT_FAILURE);
 }
 
-int **read_file(FILE *file, int *rows_size, int *cols_size) {
-  fscanf(file, "%d", rows_size);
-  fscanf(file, "%d", cols_size);
-
-  int **matrix_alloc = malloc(*rows_size * sizeof(int *));
-  if (!matrix_alloc)
-    error("error malloc matrix read_file");
+uint8_t *alloc_cells(size_t n) {
+  size_t bytes = (n + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  uint8_t *buffer = aligned_alloc(CACHE_LINE, bytes ? bytes : CACHE_LINE);
+  if (!buffer)
+    error("error aligned_alloc cells");
+  return buffer;
+}
 
-  for (int i = 0; i < *rows_size; ++i) {
-    matrix_alloc[i] = malloc(*cols_size * sizeof(int));
-    if (!matrix_alloc[i])
-      error("malloc matrix columns read_file");
+uint8_t *read_file(FILE *file, int *rows_size, int *cols_size) {
+  if (fscanf(file, "%d", rows_size) != 1 || fscanf(file, "%d", cols_size) != 1 ||
+      *rows_size < 0 || *cols_size < 0)
+    error("error reading grid size");
+
+  size_t n = (size_t)*rows_size * *cols_size;
+  uint8_t *grid = alloc_cells(n);
+  for (size_t i = 0; i < n; ++i) {
+    int value = 0;
+    if (fscanf(file, "%d", &value) != 1)
+      error("error reading grid cells");
+    grid[i] = (uint8_t)value;
   }
 
-  for (int i = 0; i < *rows_size; ++i)
-    for (int j = 0; j < *cols_size; ++j)
-      fscanf(file, "%d", &matrix_alloc[i][j]);
-
   fclose(file);
-  return matrix_alloc;
+  return grid;
+}
+
+static inline int cell_at(const uint8_t *grid, int x, int y) {
+  return grid[(size_t)x * matrix_cols_size + y];
 }
 
-int value_0_to_1(int **input_matrix, int x, int y, int rows, int cols) {
+int value_0_to_1(const uint8_t *grid, int x, int y, int rows, int cols) {
   int dx[] = {-1, -1, -1, 0, 0, 1, 1, 1};
   int dy[] = {-1, 0, 1, -1, 1, -1, 0, 1};
 
@@ -53,17 +120,18 @@ int value_0_to_1(int **input_matrix, int x, int y, int rows, int cols) {
     int nx = x + dx[i];
     int ny = y + dy[i];
     if (nx >= 0 && ny >= 0 && nx < rows && ny < cols &&
-        input_matrix[nx][ny] > 0)
+        cell_at(grid, nx, ny) > 0)
       counter0_1++;
   }
-  if (input_matrix[x][y] == 0 && counter0_1 >= 2)
+  if (cell_at(grid, x, y) == 0 && counter0_1 >= 2)
     return 1;
-  return input_matrix[x][y];
+  return cell_at(grid, x, y);
 }
 
-int value_1_to_2(int **input_matrix, int x, int y, int rows, int cols) {
-  if (input_matrix[x][y] != 1)
-    return input_matrix[x][y];
+int value_1_to_2(const uint8_t *grid, int x, int y, int rows, int cols,
+                 uint64_t key) {
+  if (cell_at(grid, x, y) != 1)
+    return cell_at(grid, x, y);
 
   int dx[] = {-1, -1, -1, 0, 0, 1, 1, 1};
   int dy[] = {-1, 0, 1, -1, 1, -1, 0, 1};
@@ -73,130 +141,505 @@ int value_1_to_2(int **input_matrix, int x, int y, int rows, int cols) {
     int nx = x + dx[i];
     int ny = y + dy[i];
     if (nx >= 0 && ny >= 0 && nx < rows && ny < cols) {
-      if (input_matrix[nx][ny] == 2)
+      if (cell_at(grid, nx, ny) == 2)
         counter1_2++;
     }
   }
 
   double P = 0.15 + (counter1_2 * 0.05);
-  double r = (double)rand() / RAND_MAX;
+  double r = crng_uniform(key, (uint64_t)x * cols + y);
   return (P > r) ? 2 : 1;
 }
 
+/* Thread 0 owns the cells that are 0 in the current state and thread 1 the
+ * ones that are 1 or 2. Both read cells[t % 2] and write disjoint cells of
+ * cells[(t + 1) % 2], so a shift needs no scratch grid and one barrier. */
 void *worker_thread(void *arg) {
   int thread_id = (int)(intptr_t)arg;
   for (int t = 0; t < shifts; ++t) {
+    const uint8_t *cur = cells[t % 2];
+    uint8_t *next = cells[(t + 1) % 2];
+    uint64_t key = crng_key(rng_seed, t);
 
-    if (thread_id == 0) {
-      for (int x = 0; x < matrix_rows_size; ++x) {
-        for (int y = 0; y < matrix_cols_size; ++y) {
-          next_state_temp[x][y] = value_0_to_1(
-              temp_matrix, x, y, matrix_rows_size, matrix_cols_size);
-        }
+    for (int x = 0; x < matrix_rows_size; ++x) {
+      for (int y = 0; y < matrix_cols_size; ++y) {
+        size_t idx = (size_t)x * matrix_cols_size + y;
+        if (thread_id == 0 && cur[idx] == 0)
+          next[idx] = (uint8_t)value_0_to_1(cur, x, y, matrix_rows_size,
+                                            matrix_cols_size);
+        else if (thread_id == 1 && cur[idx] != 0)
+          next[idx] = (uint8_t)value_1_to_2(cur, x, y, matrix_rows_size,
+                                            matrix_cols_size, key);
       }
     }
 
     pthread_barrier_wait(&barrier);
+  }
+  return NULL;
+}
+
+static inline uint64_t plane_word(const uint64_t *plane, int row, int word) {
+  if (row < 0 || row >= matrix_rows_size || word < 0 || word >= words_per_row)
+    return 0;
+  return plane[(size_t)row * words_per_row + word];
+}
+
+/* Collects the 8 neighbour masks of a word: bit j of each mask is the state
+ * bit of one neighbour of cell j, with zeros past the grid edges. */
+static inline void neighbor_masks(const uint64_t *plane, int row, int word,
+                                  uint64_t out[N_NEIGHBORS]) {
+  int n = 0;
+  for (int dr = -1; dr <= 1; ++dr) {
+    uint64_t mid = plane_word(plane, row + dr, word);
+    uint64_t left = plane_word(plane, row + dr, word - 1);
+    uint64_t right = plane_word(plane, row + dr, word + 1);
+    out[n++] = (mid << 1) | (left >> (WORD_BITS - 1));
+    out[n++] = (mid >> 1) | (right << (WORD_BITS - 1));
+    if (dr != 0)
+      out[n++] = mid;
+  }
+}
+
+int packed_step_word(const PackedGrid *cur, PackedGrid *next, int row,
+                     int word, uint64_t key) {
+  size_t idx = (size_t)row * words_per_row + word;
+  uint64_t valid = word == words_per_row - 1 ? last_word_mask : ~(uint64_t)0;
+  uint64_t nonzero = cur->nonzero[idx];
+  uint64_t two = cur->two[idx];
+
+  uint64_t masks[N_NEIGHBORS];
+  neighbor_masks(cur->nonzero, row, word, masks);
+  uint64_t seen_once = 0, seen_twice = 0;
+  for (int i = 0; i < N_NEIGHBORS; ++i) {
+    seen_twice |= seen_once & masks[i];
+    seen_once |= masks[i];
+  }
 
-    if (thread_id == 1) {
-      for (int x = 0; x < matrix_rows_size; ++x) {
-        for (int y = 0; y < matrix_cols_size; ++y) {
-          int current_val_from_temp = temp_matrix[x][y];
-          if (current_val_from_temp == 1) {
-            matrix[x][y] = value_1_to_2(temp_matrix, x, y, matrix_rows_size,
-                                        matrix_cols_size);
-          } else if (current_val_from_temp == 0) {
-            matrix[x][y] = next_state_temp[x][y];
-          } else {
-            matrix[x][y] = current_val_from_temp;
-          }
+  uint64_t next_two = two;
+  uint64_t ones = nonzero & ~two;
+  if (ones) {
+    neighbor_masks(cur->two, row, word, masks);
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    for (int i = 0; i < N_NEIGHBORS; ++i) {
+      uint64_t carry = masks[i], t;
+      t = c0 & carry; c0 ^= carry; carry = t;
+      t = c1 & carry; c1 ^= carry; carry = t;
+      t = c2 & carry; c2 ^= carry; carry = t;
+      c3 |= carry;
+    }
+    for (uint64_t m = ones; m; m &= m - 1) {
+      int bit = __builtin_ctzll(m);
+      int counter1_2 = ((c0 >> bit) & 1) | ((c1 >> bit) & 1) << 1 |
+                       ((c2 >> bit) & 1) << 2 | ((c3 >> bit) & 1) << 3;
+      double P = 0.15 + (counter1_2 * 0.05);
+      uint64_t cell = (uint64_t)row * matrix_cols_size + word * WORD_BITS + bit;
+      double r = crng_uniform(key, cell);
+      if (P > r)
+        next_two |= (uint64_t)1 << bit;
+    }
+  }
+
+  uint64_t next_nonzero = (nonzero | seen_twice) & valid;
+  next->nonzero[idx] = next_nonzero;
+  next->two[idx] = next_two;
+  return next_nonzero != nonzero || next_two != two;
+}
+
+/* A tile has to be recomputed if it holds a 1 (those change at random) or if
+ * it or any neighbouring tile changed last shift. Anything else is stable,
+ * and since it did not change, next already holds its current state. The
+ * flags for the band are written to tile_active once per shift by OR-ing
+ * the three neighbouring rows and then the three neighbouring columns;
+ * returns how many are set. */
+long mark_active_tiles(const PackedArgs *args, int parity) {
+  const uint8_t *changed = tile_changed[parity];
+  uint8_t near[words_per_row];
+  long active = 0;
+  for (int tr = args->start_tile_row; tr < args->end_tile_row; ++tr) {
+    const uint8_t *row = changed + (size_t)tr * words_per_row;
+    const uint8_t *above = tr > 0 ? row - words_per_row : row;
+    const uint8_t *below = tr + 1 < n_tile_rows ? row + words_per_row : row;
+    for (int tc = 0; tc < words_per_row; ++tc)
+      near[tc] = above[tc] | row[tc] | below[tc];
+
+    size_t base = (size_t)tr * words_per_row;
+    for (int tc = 0; tc < words_per_row; ++tc) {
+      uint8_t flag = near[tc] | tile_has_ones[parity][base + tc];
+      if (tc > 0)
+        flag |= near[tc - 1];
+      if (tc + 1 < words_per_row)
+        flag |= near[tc + 1];
+      tile_active[base + tc] = flag;
+      active += flag;
+    }
+  }
+  return active;
+}
+
+void frontier_step(PackedArgs *args, int t, uint64_t key) {
+  const PackedGrid *cur = &packed[t % 2];
+  PackedGrid *next = &packed[(t + 1) % 2];
+  int parity = t % 2;
+  int next_parity = (t + 1) % 2;
+
+  long band_tiles = (long)(args->end_tile_row - args->start_tile_row) * words_per_row;
+  long active = mark_active_tiles(args, parity);
+  int dense = active > DENSE_FRACTION * band_tiles;
+
+  for (int tr = args->start_tile_row; tr < args->end_tile_row; ++tr) {
+    int row_end = (tr + 1) * TILE_ROWS;
+    if (row_end > matrix_rows_size)
+      row_end = matrix_rows_size;
+    for (int tc = 0; tc < words_per_row; ++tc) {
+      size_t tile = (size_t)tr * words_per_row + tc;
+      int changed = 0, has_ones = 0;
+      if (dense || tile_active[tile]) {
+        for (int row = tr * TILE_ROWS; row < row_end; ++row) {
+          size_t idx = (size_t)row * words_per_row + tc;
+          changed |= packed_step_word(cur, next, row, tc, key);
+          has_ones |= (next->nonzero[idx] & ~next->two[idx]) != 0;
         }
+        args->tiles_computed++;
       }
+      tile_changed[next_parity][tile] = changed;
+      tile_has_ones[next_parity][tile] = has_ones;
     }
+  }
+}
 
+/* Each thread owns a band of rows and applies both transitions in one
+ * sweep; shift t reads packed[t % 2] and writes packed[(t + 1) % 2]. */
+void *packed_worker(void *arg) {
+  PackedArgs *args = (PackedArgs *)arg;
+  for (int t = 0; t < shifts; ++t) {
+    const PackedGrid *cur = &packed[t % 2];
+    PackedGrid *next = &packed[(t + 1) % 2];
+    uint64_t key = crng_key(rng_seed, t);
+    if (use_frontier) {
+      frontier_step(args, t, key);
+    } else {
+      for (int row = args->start_row; row < args->end_row; ++row)
+        for (int word = 0; word < words_per_row; ++word)
+          packed_step_word(cur, next, row, word, key);
+    }
     pthread_barrier_wait(&barrier);
   }
   return NULL;
 }
 
-int main(int argc, char *argv[]) {
-  srand(time(NULL));
+int packed_cell(const PackedGrid *grid, int x, int y) {
+  size_t idx = (size_t)x * words_per_row + y / WORD_BITS;
+  uint64_t bit = (uint64_t)1 << (y % WORD_BITS);
+  return (grid->nonzero[idx] & bit) ? ((grid->two[idx] & bit) ? 2 : 1) : 0;
+}
 
-  if (argc != 3)
-    error("Usage: <file> <shifts>");
+int packed_cell_fn(const void *grid, int x, int y) {
+  return packed_cell((const PackedGrid *)grid, x, y);
+}
 
-  char *filename = argv[1];
-  FILE *file = fopen(filename, "r");
-  if (!file)
-    error("error opening file");
+int byte_cell_fn(const void *grid, int x, int y) {
+  return cell_at((const uint8_t *)grid, x, y);
+}
 
-  shifts = atoi(argv[2]);
+const void *state_grid(int shift) {
+  if (use_packed)
+    return &packed[shift % 2];
+  return cells[shift % 2];
+}
 
-  temp_matrix = read_file(file, &matrix_rows_size, &matrix_cols_size);
+cell_fn state_cell(void) { return use_packed ? packed_cell_fn : byte_cell_fn; }
 
-  printf("Estado inicial\n");
+/* Binary snapshots: "DFPS", int32 rows, int32 cols, then per snapshot an
+ * int32 shift followed by rows * cols bytes. */
+void write_snapshot(SnapshotWriter *w, int shift, const void *grid,
+                    cell_fn cell) {
+  if (w->binary) {
+    int32_t header = shift;
+    fwrite(&header, sizeof(header), 1, w->binary);
+    for (int x = 0; x < matrix_rows_size; ++x) {
+      for (int y = 0; y < matrix_cols_size; ++y)
+        w->row[y] = (uint8_t)cell(grid, x, y);
+      fwrite(w->row, 1, matrix_cols_size, w->binary);
+    }
+    return;
+  }
+
+  if (shift == 0)
+    printf("Estado inicial\n");
+  else
+    printf("Iteracion %d\n", shift);
   for (int x = 0; x < matrix_rows_size; ++x) {
     for (int y = 0; y < matrix_cols_size; ++y)
-      printf("%3d", temp_matrix[x][y]);
+      printf("%3d", cell(grid, x, y));
     printf("\n");
   }
   printf("\n");
+}
 
-  matrix = malloc(matrix_rows_size * sizeof(int *));
-  if (!matrix)
-    error("error malloc matrix main");
-  for (int i = 0; i < matrix_rows_size; ++i) {
-    matrix[i] = malloc(matrix_cols_size * sizeof(int));
-    if (!matrix[i])
-      error("malloc matrix columns main");
+void *writer_thread(void *arg) {
+  SnapshotWriter *w = (SnapshotWriter *)arg;
+  pthread_mutex_lock(&w->mutex);
+  while (1) {
+    while (!w->busy && !w->done)
+      pthread_cond_wait(&w->cond, &w->mutex);
+    if (!w->busy)
+      break;
+    pthread_mutex_unlock(&w->mutex);
+
+    write_snapshot(w, w->shift, w->grid, w->cell);
+
+    pthread_mutex_lock(&w->mutex);
+    w->busy = 0;
+    pthread_cond_broadcast(&w->cond);
   }
+  pthread_mutex_unlock(&w->mutex);
+  return NULL;
+}
 
-  next_state_temp = malloc(matrix_rows_size * sizeof(int *));
-  if (!next_state_temp)
-    error("error malloc next_state_temp");
-  for (int i = 0; i < matrix_rows_size; ++i) {
-    next_state_temp[i] = malloc(matrix_cols_size * sizeof(int));
-    if (!next_state_temp[i])
-      error("malloc next_state_temp columns");
-  }
+void snapshot_wait(SnapshotWriter *w) {
+  pthread_mutex_lock(&w->mutex);
+  while (w->busy)
+    pthread_cond_wait(&w->cond, &w->mutex);
+  pthread_mutex_unlock(&w->mutex);
+}
 
-  pthread_t threads[N_THREADS];
-  pthread_barrier_init(&barrier, NULL, N_THREADS + 1);
+void snapshot_post(SnapshotWriter *w, int shift, const void *grid,
+                   cell_fn cell) {
+  pthread_mutex_lock(&w->mutex);
+  w->shift = shift;
+  w->grid = grid;
+  w->cell = cell;
+  w->busy = 1;
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+}
 
-  for (int i = 0; i < N_THREADS; ++i) {
-    pthread_create(&threads[i], NULL, worker_thread, (void *)(intptr_t)i);
-  }
+int snapshot_due(int shift) {
+  if (quiet && !writer.binary)
+    return 0;
+  return shift % print_every == 0 || shift == shifts;
+}
+
+/* Releases the workers one shift at a time. The writer may still be reading
+ * state i - 1 when shift i - 1 finishes, and shift i overwrites it, so the
+ * driver waits for the writer before passing the barrier. */
+double drive_shifts(void) {
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
 
+  cell_fn cell = state_cell();
+  if (snapshot_due(0))
+    snapshot_post(&writer, 0, state_grid(0), cell);
   for (int i = 1; i <= shifts; ++i) {
+    snapshot_wait(&writer);
     pthread_barrier_wait(&barrier);
-    pthread_barrier_wait(&barrier);
+    if (snapshot_due(i))
+      snapshot_post(&writer, i, state_grid(i), cell);
+  }
+  snapshot_wait(&writer);
 
-    printf("Iteracion %d\n", i);
-    for (int x = 0; x < matrix_rows_size; ++x) {
-      for (int y = 0; y < matrix_cols_size; ++y)
-        printf("%3d", matrix[x][y]);
-      printf("\n");
-    }
-    printf("\n");
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  return (t_end.tv_sec - t_start.tv_sec) +
+         (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+}
 
+void print_summary(double seconds) {
+  if (quiet) {
+    long counts[3] = {0, 0, 0};
+    const void *grid = state_grid(shifts);
+    cell_fn cell = state_cell();
     for (int x = 0; x < matrix_rows_size; ++x)
       for (int y = 0; y < matrix_cols_size; ++y)
-        temp_matrix[x][y] = matrix[x][y];
+        counts[cell(grid, x, y)]++;
+    printf("Estado final: %ld en 0, %ld en 1, %ld en 2\n", counts[0],
+           counts[1], counts[2]);
   }
+  printf("Tiempo: %.4f s (%.2f Mceldas/s)\n", seconds,
+         seconds > 0 ? (double)matrix_rows_size * matrix_cols_size * shifts / seconds / 1e6 : 0.0);
+}
 
-  for (int i = 0; i < N_THREADS; ++i)
+int packed_main(int n_threads) {
+  words_per_row = (matrix_cols_size + WORD_BITS - 1) / WORD_BITS;
+  int tail_bits = matrix_cols_size % WORD_BITS;
+  last_word_mask = tail_bits ? ((uint64_t)1 << tail_bits) - 1 : ~(uint64_t)0;
+  size_t words = (size_t)matrix_rows_size * words_per_row;
+
+  for (int b = 0; b < 2; ++b) {
+    packed[b].nonzero = calloc(words ? words : 1, sizeof(uint64_t));
+    packed[b].two = calloc(words ? words : 1, sizeof(uint64_t));
+    if (!packed[b].nonzero || !packed[b].two)
+      error("error calloc packed grid");
+  }
+
+  for (int x = 0; x < matrix_rows_size; ++x) {
+    for (int y = 0; y < matrix_cols_size; ++y) {
+      size_t idx = (size_t)x * words_per_row + y / WORD_BITS;
+      uint64_t bit = (uint64_t)1 << (y % WORD_BITS);
+      int value = cell_at(cells[0], x, y);
+      if (value > 0)
+        packed[0].nonzero[idx] |= bit;
+      if (value == 2)
+        packed[0].two[idx] |= bit;
+    }
+  }
+  free(cells[0]);
+  cells[0] = NULL;
+
+  n_tile_rows = (matrix_rows_size + TILE_ROWS - 1) / TILE_ROWS;
+  size_t n_tiles = (size_t)n_tile_rows * words_per_row;
+  if (use_frontier) {
+    for (int b = 0; b < 2; ++b) {
+      tile_changed[b] = calloc(n_tiles ? n_tiles : 1, 1);
+      tile_has_ones[b] = calloc(n_tiles ? n_tiles : 1, 1);
+      if (!tile_changed[b] || !tile_has_ones[b])
+        error("error calloc tile flags");
+    }
+    tile_active = calloc(n_tiles ? n_tiles : 1, 1);
+    if (!tile_active)
+      error("error calloc tile flags");
+    memset(tile_changed[0], 1, n_tiles);
+  }
+
+  pthread_t threads[n_threads];
+  PackedArgs thread_args[n_threads];
+  pthread_barrier_init(&barrier, NULL, n_threads + 1);
+
+  for (int i = 0; i < n_threads; ++i) {
+    if (use_frontier) {
+      blas1_range(n_tile_rows, n_threads, i, &thread_args[i].start_tile_row,
+                  &thread_args[i].end_tile_row);
+      thread_args[i].start_row = thread_args[i].start_tile_row * TILE_ROWS;
+      thread_args[i].end_row = thread_args[i].end_tile_row * TILE_ROWS;
+    } else {
+      blas1_range(matrix_rows_size, n_threads, i, &thread_args[i].start_row,
+                  &thread_args[i].end_row);
+    }
+    thread_args[i].tiles_computed = 0;
+    pthread_create(&threads[i], NULL, packed_worker, (void *)&thread_args[i]);
+  }
+
+  double seconds = drive_shifts();
+
+  long tiles_computed = 0;
+  for (int i = 0; i < n_threads; ++i) {
     pthread_join(threads[i], NULL);
+    tiles_computed += thread_args[i].tiles_computed;
+  }
+
+  print_summary(seconds);
+  if (use_frontier)
+    printf("Teselas recalculadas: %ld de %ld (%.1f%%)\n", tiles_computed,
+           (long)(n_tiles * shifts),
+           n_tiles * shifts > 0 ? 100.0 * tiles_computed / (n_tiles * shifts) : 0.0);
 
   pthread_barrier_destroy(&barrier);
+  for (int b = 0; b < 2; ++b) {
+    free(packed[b].nonzero);
+    free(packed[b].two);
+    free(tile_changed[b]);
+    free(tile_has_ones[b]);
+  }
+  free(tile_active);
+
+  return EXIT_SUCCESS;
+}
+
+int classic_main(void) {
+  cells[1] = alloc_cells((size_t)matrix_rows_size * matrix_cols_size);
+
+  pthread_t threads[N_THREADS];
+  pthread_barrier_init(&barrier, NULL, N_THREADS + 1);
 
-  for (int i = 0; i < matrix_rows_size; ++i) {
-    free(temp_matrix[i]);
-    free(matrix[i]);
-    free(next_state_temp[i]);
+  for (int i = 0; i < N_THREADS; ++i) {
+    pthread_create(&threads[i], NULL, worker_thread, (void *)(intptr_t)i);
   }
-  free(temp_matrix);
-  free(matrix);
-  free(next_state_temp);
+
+  double seconds = drive_shifts();
+
+  for (int i = 0; i < N_THREADS; ++i)
+    pthread_join(threads[i], NULL);
+
+  print_summary(seconds);
+
+  pthread_barrier_destroy(&barrier);
+  free(cells[0]);
+  free(cells[1]);
 
   return EXIT_SUCCESS;
 }
+
+#define USAGE                                                                  \
+  "Usage: <file> <shifts> [--packed|--frontier] [--quiet] [--threads=N] "     \
+  "[--seed=N] [--print-every=N] [--snapshot=path]"
+
+int main(int argc, char *argv[]) {
+  rng_seed = (uint64_t)time(NULL);
+
+  if (argc < 3)
+    error(USAGE);
+
+  int n_threads = 0;
+  const char *snapshot_path = NULL;
+  for (int i = 3; i < argc; ++i) {
+    if (strcmp(argv[i], "--packed") == 0)
+      use_packed = 1;
+    else if (strcmp(argv[i], "--frontier") == 0)
+      use_packed = use_frontier = 1;
+    else if (strcmp(argv[i], "--quiet") == 0)
+      quiet = 1;
+    else if (strncmp(argv[i], "--threads=", 10) == 0)
+      n_threads = atoi(argv[i] + 10);
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      rng_seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--print-every=", 14) == 0)
+      print_every = atoi(argv[i] + 14);
+    else if (strncmp(argv[i], "--snapshot=", 11) == 0)
+      snapshot_path = argv[i] + 11;
+    else
+      error(USAGE);
+  }
+  if (print_every <= 0)
+    error("--print-every must be greater than 0");
+  if (n_threads <= 0)
+    n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads <= 0)
+    n_threads = 1;
+
+  char *filename = argv[1];
+  FILE *file = fopen(filename, "r");
+  if (!file)
+    error("error opening file");
+
+  shifts = atoi(argv[2]);
+
+  cells[0] = read_file(file, &matrix_rows_size, &matrix_cols_size);
+
+  pthread_mutex_init(&writer.mutex, NULL);
+  pthread_cond_init(&writer.cond, NULL);
+  if (snapshot_path) {
+    writer.binary = fopen(snapshot_path, "wb");
+    writer.row = malloc(matrix_cols_size ? matrix_cols_size : 1);
+    if (!writer.binary || !writer.row)
+      error("error opening snapshot file");
+    int32_t header[2] = {matrix_rows_size, matrix_cols_size};
+    fwrite("DFPS", 1, 4, writer.binary);
+    fwrite(header, sizeof(int32_t), 2, writer.binary);
+  }
+  pthread_t writer_tid;
+  pthread_create(&writer_tid, NULL, writer_thread, (void *)&writer);
+
+  int status = use_packed ? packed_main(n_threads) : classic_main();
+
+  pthread_mutex_lock(&writer.mutex);
+  writer.done = 1;
+  pthread_cond_broadcast(&writer.cond);
+  pthread_mutex_unlock(&writer.mutex);
+  pthread_join(writer_tid, NULL);
+  pthread_mutex_destroy(&writer.mutex);
+  pthread_cond_destroy(&writer.cond);
+  if (writer.binary)
+    fclose(writer.binary);
+  free(writer.row);
+
+  return status;
+}
@@ -1,33 +1,152 @@
 #include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "blas1.h"
+#include "counter_rng.h"
+
 #define MAX_POPULATION_CONST 250
+#define SHOWN_INDIVIDUALS 10
+#define SHOWN_FEATURES 4
+#define TOURNAMENT_SIZE 3
+#define CROSSOVER_RATE 0.8
+#define MUTATION_RATE 0.1
+#define MUTATION_SCALE (0.05 * MAX_POPULATION_CONST)
+#define CACHE_LINE 64
+#define DOUBLES_PER_LINE (CACHE_LINE / (int)sizeof(double))
+#define FITNESS_BLOCK 512
+#define MIGRANTS 2
+#define DEFAULT_CHUNK 1024
+/* fitness_costly_batch spends 1 to COSTLY_MAX_UNITS units of
+ * COSTLY_UNIT_ITERATIONS dependent flops per individual. */
+#define COSTLY_MAX_UNITS 100
+#define COSTLY_UNIT_ITERATIONS 32
+#define MEMO_EMPTY 0
+#define MEMO_BUSY UINT64_MAX
+#define MAILBOX_SLOTS 16
+
+/* Structure of arrays: feature f of individual i is features[f * stride + i]
+ * and its score is fitness[i]. stride rounds n up to a cache line so every
+ * feature column starts aligned. */
+typedef struct {
+  int n;
+  int n_features;
+  size_t stride;
+  double *features;
+  double *fitness;
+} Population;
+
+/* Writes fitness[start, end) from the feature columns of pop. */
+typedef void (*fitness_batch_fn)(const Population *pop, int start, int end);
 
 typedef struct {
-  double feature1;
-  double feature2;
   double fitness;
-} Individual;
+  int index;
+} RankEntry;
 
 typedef struct {
-  Individual *individual;
   int start_index;
   int end_index;
   int thread_id;
   pthread_barrier_t *barrier;
   int *current_generation;
   int total_generations;
+  RankEntry *heap;
+  int heap_size;
+  double best_fitness;
+  double fitness_sum;
+  long evaluated;
 } ThreadArgs;
 
-Individual *g_individuals;
+/* Fitness memo: open addressing on the genome hash with seqlock-style
+ * slots. A writer claims a slot by swapping its key to MEMO_BUSY, so
+ * concurrent writers never interleave; a reader only trusts a fitness read
+ * between two identical loads of the key. Failing to claim just skips the
+ * store, it is only a cache. */
+typedef struct {
+  atomic_uint_fast64_t key;
+  _Atomic double fitness;
+} MemoSlot;
+
+typedef struct {
+  MemoSlot *slots;
+  size_t mask;
+  atomic_long hits;
+  atomic_long misses;
+} FitnessMemo;
+
+/* Generation k is evaluated in g_individuals and its children are bred into
+ * g_offspring; main swaps the two once the generation is done. With
+ * --elite=k each worker keeps a min-heap of its k best and main merges the
+ * heaps; otherwise the workers rank (fitness, index) pairs with a merge sort
+ * that ping-pongs between g_ranking and g_rank_scratch. */
+Population *g_individuals;
+Population *g_offspring;
+RankEntry *g_ranking;
+RankEntry *g_rank_scratch;
+fitness_batch_fn g_fitness_batch;
+fitness_batch_fn g_fitness_inner;
+FitnessMemo g_memo;
+atomic_int g_eval_cursor;
+int g_chunk = DEFAULT_CHUNK;
+volatile double g_costly_sink;
 int g_n_individuals;
-pthread_mutex_t individuals_mutex;
+int g_n_features = 2;
+int g_n_threads;
+int g_elite = 0;
+int g_rank = 1;
 pthread_barrier_t generation_barrier;
+pthread_barrier_t worker_barrier;
 int g_current_generation = 0;
 int g_total_generations;
+uint64_t g_seed;
+int g_has_target = 0;
+double g_target;
+
+typedef struct {
+  int reached;
+  int generation;
+  double seconds;
+  double total_seconds;
+} TargetResult;
+
+/* Single-producer single-consumer ring: island i - 1 pushes migrants into
+ * island i's mailbox and only island i pops them. A slot is a fitness
+ * followed by the features. A full ring drops the migrant, so no island
+ * ever waits for a neighbour. */
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_uint head;
+  _Alignas(CACHE_LINE) atomic_uint tail;
+  double *slots;
+} Mailbox;
+
+typedef struct {
+  int id;
+  int start_index;
+  int end_index;
+  int migrate_every;
+  Mailbox *inbox;
+  Mailbox *outbox;
+  int generations;
+  double best_fitness;
+  long sent;
+  long received;
+  long dropped;
+} IslandArgs;
+
+atomic_int g_target_reached;
+int g_target_island;
+int g_target_generation;
+struct timespec g_run_start;
+struct timespec g_target_time;
 
 void error(const char *err) {
   perror(err);
@@ -43,25 +162,371 @@ void println(const char *fmt, ...) {
   putchar('\n');
 }
 
-double fitness_calc(double feature1, double feature2) {
-  return (feature1 * feature2) / 2.0;
+double elapsed_seconds(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+Population *population_create(int n, int n_features) {
+  Population *pop = (Population *)malloc(sizeof(Population));
+  if (!pop)
+    error("error malloc population");
+  pop->n = n;
+  pop->n_features = n_features;
+  pop->stride = ((size_t)n + DOUBLES_PER_LINE - 1) / DOUBLES_PER_LINE *
+                DOUBLES_PER_LINE;
+  size_t column = pop->stride ? pop->stride : DOUBLES_PER_LINE;
+  pop->features = (double *)aligned_alloc(
+      CACHE_LINE, column * n_features * sizeof(double));
+  pop->fitness = (double *)aligned_alloc(CACHE_LINE, column * sizeof(double));
+  if (!pop->features || !pop->fitness)
+    error("error aligned_alloc population");
+  return pop;
+}
+
+void population_destroy(Population *pop) {
+  free(pop->features);
+  free(pop->fitness);
+  free(pop);
+}
+
+static inline double *feature_column(const Population *pop, int f) {
+  return pop->features + (size_t)f * pop->stride;
 }
 
-int compare_individuals(const void *a, const void *b) {
-  Individual *individualA = (Individual *)a;
-  Individual *individualB = (Individual *)b;
-  if (individualA->fitness < individualB->fitness) {
-    return 1;
-  } else if (individualA->fitness > individualB->fitness) {
-    return -1;
-  } else {
+/* Features are taken in pairs and each pair adds (a * b) / 2, so two
+ * features give the original (feature1 * feature2) / 2. An odd trailing
+ * feature is paired with itself. */
+double fitness_calc(const double *features, int n_features) {
+  double fitness = 0.0;
+  for (int f = 0; f < n_features; f += 2) {
+    double a = features[f];
+    double b = f + 1 < n_features ? features[f + 1] : a;
+    fitness += a * b;
+  }
+  return fitness / 2.0;
+}
+
+#if defined(__AVX2__)
+const char *fitness_kernel_name = "AVX2";
+
+void accumulate_product(double *restrict out, const double *restrict a,
+                        const double *restrict b, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d product = _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                    _mm256_loadu_pd(b + i));
+    _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(out + i), product));
+  }
+  for (; i < n; ++i)
+    out[i] += a[i] * b[i];
+}
+#elif defined(__SSE2__)
+const char *fitness_kernel_name = "SSE2";
+
+void accumulate_product(double *restrict out, const double *restrict a,
+                        const double *restrict b, int n) {
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d product = _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+    _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(out + i), product));
+  }
+  for (; i < n; ++i)
+    out[i] += a[i] * b[i];
+}
+#else
+const char *fitness_kernel_name = "scalar";
+
+void accumulate_product(double *restrict out, const double *restrict a,
+                        const double *restrict b, int n) {
+  for (int i = 0; i < n; ++i)
+    out[i] += a[i] * b[i];
+}
+#endif
+
+/* Same sum as fitness_calc, but one feature pair at a time over a block of
+ * individuals so the inner loop is a vector multiply-add over contiguous
+ * columns. Blocks keep the partial sums in L1 across feature pairs. */
+void fitness_pairs_batch(const Population *pop, int start, int end) {
+  for (int block = start; block < end; block += FITNESS_BLOCK) {
+    int count = end - block < FITNESS_BLOCK ? end - block : FITNESS_BLOCK;
+    double *out = pop->fitness + block;
+    for (int i = 0; i < count; ++i)
+      out[i] = 0.0;
+    for (int f = 0; f < pop->n_features; f += 2) {
+      const double *a = feature_column(pop, f) + block;
+      const double *b =
+          f + 1 < pop->n_features ? feature_column(pop, f + 1) + block : a;
+      accumulate_product(out, a, b, count);
+    }
+    for (int i = 0; i < count; ++i)
+      out[i] /= 2.0;
+  }
+}
+
+static inline uint64_t genome_hash(const Population *pop, int i) {
+  uint64_t h = crng_mix((uint64_t)pop->n_features);
+  for (int f = 0; f < pop->n_features; ++f) {
+    uint64_t bits;
+    double value = feature_column(pop, f)[i];
+    memcpy(&bits, &value, sizeof(bits));
+    h = crng_mix(h ^ bits);
+  }
+  return h == MEMO_EMPTY || h == MEMO_BUSY ? h ^ 1 : h;
+}
+
+/* Stand-in for an expensive model: same value as fitness_pairs_batch, but
+ * each genome costs between 1 and COSTLY_MAX_UNITS work units. */
+void fitness_costly_batch(const Population *pop, int start, int end) {
+  fitness_pairs_batch(pop, start, end);
+  for (int i = start; i < end; ++i) {
+    int units = 1 + (int)(genome_hash(pop, i) % COSTLY_MAX_UNITS);
+    double x = pop->fitness[i];
+    for (int u = 0; u < units * COSTLY_UNIT_ITERATIONS; ++u)
+      x = x * 0.999999 + 1e-6;
+    g_costly_sink = x;
+  }
+}
+
+int memo_lookup(FitnessMemo *memo, uint64_t key, double *fitness) {
+  MemoSlot *slot = &memo->slots[key & memo->mask];
+  if (atomic_load_explicit(&slot->key, memory_order_acquire) != key)
+    return 0;
+  double value = atomic_load_explicit(&slot->fitness, memory_order_relaxed);
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&slot->key, memory_order_relaxed) != key)
     return 0;
+  *fitness = value;
+  return 1;
+}
+
+void memo_store(FitnessMemo *memo, uint64_t key, double fitness) {
+  MemoSlot *slot = &memo->slots[key & memo->mask];
+  uint64_t seen = atomic_load_explicit(&slot->key, memory_order_relaxed);
+  if (seen == key || seen == MEMO_BUSY ||
+      !atomic_compare_exchange_strong(&slot->key, &seen, MEMO_BUSY))
+    return;
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&slot->fitness, fitness, memory_order_relaxed);
+  atomic_store_explicit(&slot->key, key, memory_order_release);
+}
+
+/* Fills hits from the memo and hands each run of consecutive misses to
+ * g_fitness_inner, so the batch kernel still sees contiguous ranges. */
+void fitness_memo_batch(const Population *pop, int start, int end) {
+  uint64_t keys[DEFAULT_CHUNK];
+  long hits = 0;
+  for (int base = start; base < end; base += DEFAULT_CHUNK) {
+    int count = end - base < DEFAULT_CHUNK ? end - base : DEFAULT_CHUNK;
+    int run = -1;
+    for (int i = 0; i <= count; ++i) {
+      int hit = 0;
+      if (i < count) {
+        keys[i] = genome_hash(pop, base + i);
+        hit = memo_lookup(&g_memo, keys[i], &pop->fitness[base + i]);
+        hits += hit;
+      }
+      if ((hit || i == count) && run >= 0) {
+        g_fitness_inner(pop, base + run, base + i);
+        for (int m = run; m < i; ++m)
+          memo_store(&g_memo, keys[m], pop->fitness[base + m]);
+        run = -1;
+      } else if (!hit && i < count && run < 0) {
+        run = i;
+      }
+    }
+  }
+  atomic_fetch_add_explicit(&g_memo.hits, hits, memory_order_relaxed);
+  atomic_fetch_add_explicit(&g_memo.misses, (end - start) - hits,
+                            memory_order_relaxed);
+}
+
+/* Only call while no worker is evaluating. */
+void memo_clear(FitnessMemo *memo) {
+  for (size_t i = 0; i <= memo->mask; ++i) {
+    atomic_init(&memo->slots[i].key, MEMO_EMPTY);
+    atomic_init(&memo->slots[i].fitness, 0.0);
+  }
+  atomic_init(&memo->hits, 0);
+  atomic_init(&memo->misses, 0);
+}
+
+void memo_init(FitnessMemo *memo, long entries) {
+  size_t size = 1;
+  while (size < (size_t)entries)
+    size *= 2;
+  memo->slots = (MemoSlot *)aligned_alloc(CACHE_LINE,
+                                          size * sizeof(MemoSlot) < CACHE_LINE
+                                              ? CACHE_LINE
+                                              : size * sizeof(MemoSlot));
+  if (!memo->slots)
+    error("error aligned_alloc memo");
+  memo->mask = size - 1;
+  memo_clear(memo);
+}
+
+/* Best first; ties keep the lower index first so the result is the same for
+ * any thread count. */
+int compare_ranks(const void *a, const void *b) {
+  const RankEntry *ra = (const RankEntry *)a;
+  const RankEntry *rb = (const RankEntry *)b;
+  if (ra->fitness != rb->fitness)
+    return ra->fitness < rb->fitness ? 1 : -1;
+  return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+/* Min-heap on compare_ranks order: the root is the worst elite kept. */
+void heap_sift_down(RankEntry *heap, int size, int i) {
+  while (1) {
+    int worst = i;
+    int left = 2 * i + 1, right = 2 * i + 2;
+    if (left < size && compare_ranks(&heap[left], &heap[worst]) > 0)
+      worst = left;
+    if (right < size && compare_ranks(&heap[right], &heap[worst]) > 0)
+      worst = right;
+    if (worst == i)
+      return;
+    RankEntry tmp = heap[i];
+    heap[i] = heap[worst];
+    heap[worst] = tmp;
+    i = worst;
+  }
+}
+
+void heap_offer(ThreadArgs *args, RankEntry entry) {
+  RankEntry *heap = args->heap;
+  if (args->heap_size < g_elite) {
+    int i = args->heap_size++;
+    heap[i] = entry;
+    while (i > 0) {
+      int parent = (i - 1) / 2;
+      if (compare_ranks(&heap[i], &heap[parent]) <= 0)
+        break;
+      RankEntry tmp = heap[i];
+      heap[i] = heap[parent];
+      heap[parent] = tmp;
+      i = parent;
+    }
+  } else if (compare_ranks(&entry, &heap[0]) < 0) {
+    heap[0] = entry;
+    heap_sift_down(heap, args->heap_size, 0);
+  }
+}
+
+int slice_start(int thread_id) {
+  int start, end;
+  if (thread_id >= g_n_threads)
+    return g_n_individuals;
+  blas1_range(g_n_individuals, g_n_threads, thread_id, &start, &end);
+  return start;
+}
+
+/* Merge path: number of elements taken from a when the first k outputs of
+ * merging a and b are produced, with ties going to a. */
+int co_rank(int k, const RankEntry *a, int m, const RankEntry *b, int n) {
+  int lo = k > n ? k - n : 0;
+  int hi = k < m ? k : m;
+  while (lo < hi) {
+    int i = (lo + hi) / 2;
+    int j = k - i;
+    if (j == 0 || compare_ranks(&a[i], &b[j - 1]) > 0)
+      hi = i;
+    else
+      lo = i + 1;
+  }
+  return lo;
+}
+
+/* Each thread sorts its slice of g_ranking, then every round merges pairs of
+ * runs. All threads of a pair's group share the merge by splitting its
+ * output evenly, so no round leaves threads idle. Returns the buffer holding
+ * the result. */
+RankEntry *parallel_merge_sort(int thread_id) {
+  RankEntry *src = g_ranking;
+  RankEntry *dst = g_rank_scratch;
+  int own_start = slice_start(thread_id);
+  qsort(src + own_start, slice_start(thread_id + 1) - own_start,
+        sizeof(RankEntry), compare_ranks);
+
+  for (int step = 1; step < g_n_threads; step *= 2) {
+    pthread_barrier_wait(&worker_barrier);
+
+    int group = thread_id / (2 * step) * (2 * step);
+    int lo = slice_start(group);
+    int mid = slice_start(group + step);
+    int hi = slice_start(group + 2 * step);
+    int group_size = g_n_threads - group < 2 * step ? g_n_threads - group
+                                                    : 2 * step;
+    int k_start, k_end;
+    blas1_range(hi - lo, group_size, thread_id - group, &k_start, &k_end);
+
+    const RankEntry *a = src + lo, *b = src + mid;
+    int m = mid - lo, n = hi - mid;
+    int i = co_rank(k_start, a, m, b, n), j = k_start - i;
+    int i_end = co_rank(k_end, a, m, b, n), j_end = k_end - i_end;
+    RankEntry *out = dst + lo + k_start;
+    while (i < i_end && j < j_end)
+      *out++ = compare_ranks(&b[j], &a[i]) < 0 ? b[j++] : a[i++];
+    while (i < i_end)
+      *out++ = a[i++];
+    while (j < j_end)
+      *out++ = b[j++];
+
+    RankEntry *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  return src;
+}
+
+double clamp_feature(double value) {
+  if (value < 0.0)
+    return 0.0;
+  if (value > MAX_POPULATION_CONST)
+    return MAX_POPULATION_CONST;
+  return value;
+}
+
+/* Random draws per child: two tournaments, the crossover chance, the blend
+ * factor, and a chance plus a step for each feature's mutation. */
+static inline uint64_t draws_per_child(int n_features) {
+  return 2 * TOURNAMENT_SIZE + 2 + 2 * (uint64_t)n_features;
+}
+
+int tournament(const Population *pop, uint64_t key, uint64_t counter) {
+  int best = -1;
+  for (int i = 0; i < TOURNAMENT_SIZE; ++i) {
+    int candidate = (int)(crng_u64(key, counter + i) % (uint64_t)pop->n);
+    if (best < 0 || pop->fitness[candidate] > pop->fitness[best])
+      best = candidate;
+  }
+  return best;
+}
+
+/* Child i only depends on the evaluated population and its own counters, so
+ * any thread can breed any slice without locks. */
+void breed(const Population *pop, Population *children, int i, uint64_t key) {
+  uint64_t counter = (uint64_t)i * draws_per_child(pop->n_features);
+  int a = tournament(pop, key, counter);
+  int b = tournament(pop, key, counter + TOURNAMENT_SIZE);
+  counter += 2 * TOURNAMENT_SIZE;
+
+  /* Without crossover the child starts as a copy of a, so unmutated
+   * survivors keep their exact genome (and hit the fitness memo). */
+  int cross = crng_uniform(key, counter++) < CROSSOVER_RATE;
+  double alpha = cross ? crng_uniform(key, counter) : 1.0;
+  counter++;
+  for (int f = 0; f < pop->n_features; ++f) {
+    const double *column = feature_column(pop, f);
+    double value = alpha * column[a] + (1.0 - alpha) * column[b];
+    if (crng_uniform(key, counter) < MUTATION_RATE)
+      value += (2.0 * crng_uniform(key, counter + 1) - 1.0) * MUTATION_SCALE;
+    counter += 2;
+    feature_column(children, f)[i] = clamp_feature(value);
   }
 }
 
 void *worker_thread(void *arg) {
   ThreadArgs *args = (ThreadArgs *)arg;
-  Individual *local_individual = args->individual;
   int start = args->start_index;
   int end = args->end_index;
   pthread_barrier_t *barrier = args->barrier;
@@ -75,13 +540,44 @@ void *worker_thread(void *arg) {
       break;
     }
 
+    /* Evaluation cost varies per genome, so chunks are handed out from a
+     * shared cursor that main resets before each generation. */
+    const Population *pop = g_individuals;
+    int chunk_start;
+    while ((chunk_start = atomic_fetch_add_explicit(
+                &g_eval_cursor, g_chunk, memory_order_relaxed)) < pop->n) {
+      int chunk_end =
+          pop->n - chunk_start < g_chunk ? pop->n : chunk_start + g_chunk;
+      g_fitness_batch(pop, chunk_start, chunk_end);
+      args->evaluated += chunk_end - chunk_start;
+    }
+
+    /* Tournaments and the reduction read fitness from every chunk. */
+    pthread_barrier_wait(&worker_barrier);
+
+    double best = 0.0, sum = 0.0;
     for (int i = start; i < end; ++i) {
-      local_individual[i].fitness = fitness_calc(local_individual[i].feature1,
-                                                 local_individual[i].feature2);
-      local_individual[i].feature1 =
-          (double)rand() / RAND_MAX * MAX_POPULATION_CONST;
-      local_individual[i].feature2 =
-          (double)rand() / RAND_MAX * MAX_POPULATION_CONST;
+      if (i == start || pop->fitness[i] > best)
+        best = pop->fitness[i];
+      sum += pop->fitness[i];
+    }
+    args->best_fitness = best;
+    args->fitness_sum = sum;
+
+    uint64_t key = crng_key(g_seed, *current_generation);
+    for (int i = start; i < end; ++i)
+      breed(pop, g_offspring, i, key);
+
+    if (!g_rank) {
+      /* Timing-only runs skip ranking; main only needs the reduction. */
+    } else if (g_elite > 0) {
+      args->heap_size = 0;
+      for (int i = start; i < end; ++i)
+        heap_offer(args, (RankEntry){pop->fitness[i], i});
+    } else {
+      for (int i = start; i < end; ++i)
+        g_ranking[i] = (RankEntry){pop->fitness[i], i};
+      parallel_merge_sort(args->thread_id);
     }
 
     pthread_barrier_wait(barrier);
@@ -90,83 +586,495 @@ void *worker_thread(void *arg) {
   return NULL;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc != 4)
-    error("Usage: <n_individuals> <n_threads> <n_generations>");
+void print_individual(int rank, const Population *pop, int i) {
+  char line[256];
+  int len = snprintf(line, sizeof(line), "  Individuo %d:", rank);
+  for (int f = 0; f < pop->n_features && f < SHOWN_FEATURES; ++f)
+    len += snprintf(line + len, sizeof(line) - len, "%s F%d=%.2f",
+                    f ? "," : "", f + 1, feature_column(pop, f)[i]);
+  if (pop->n_features > SHOWN_FEATURES)
+    len += snprintf(line + len, sizeof(line) - len, ", ...");
+  println("%s, Fitness=%.2f", line, pop->fitness[i]);
+}
 
-  g_n_individuals = atoi(argv[1]);
-  int n_threads = atoi(argv[2]);
-  g_total_generations = atoi(argv[3]);
+/* Individual i of pop gets the features global individual first_index + i
+ * had in the synchronous model, so both models start from the same pool. */
+void init_features(Population *pop, int first_index) {
+  uint64_t init_key = crng_key(g_seed, 0);
+  for (int f = 0; f < pop->n_features; ++f) {
+    double *column = feature_column(pop, f);
+    for (int i = 0; i < pop->n; ++i)
+      column[i] = crng_uniform(init_key, (uint64_t)pop->n_features *
+                                             (first_index + i) + f) *
+                  MAX_POPULATION_CONST;
+  }
+}
 
-  srand(time(NULL));
+int mailbox_push(Mailbox *box, const Population *pop, int i) {
+  unsigned tail = atomic_load_explicit(&box->tail, memory_order_relaxed);
+  unsigned head = atomic_load_explicit(&box->head, memory_order_acquire);
+  if (tail - head == MAILBOX_SLOTS)
+    return 0;
+  double *slot = box->slots + (size_t)(tail % MAILBOX_SLOTS) * (pop->n_features + 1);
+  slot[0] = pop->fitness[i];
+  for (int f = 0; f < pop->n_features; ++f)
+    slot[f + 1] = feature_column(pop, f)[i];
+  atomic_store_explicit(&box->tail, tail + 1, memory_order_release);
+  return 1;
+}
 
-  g_individuals = (Individual *)malloc(g_n_individuals * sizeof(Individual));
-  if (!g_individuals)
-    error("error malloc g_individuals");
+int mailbox_pop(Mailbox *box, Population *pop, int i) {
+  unsigned head = atomic_load_explicit(&box->head, memory_order_relaxed);
+  unsigned tail = atomic_load_explicit(&box->tail, memory_order_acquire);
+  if (head == tail)
+    return 0;
+  const double *slot =
+      box->slots + (size_t)(head % MAILBOX_SLOTS) * (pop->n_features + 1);
+  pop->fitness[i] = slot[0];
+  for (int f = 0; f < pop->n_features; ++f)
+    feature_column(pop, f)[i] = slot[f + 1];
+  atomic_store_explicit(&box->head, head + 1, memory_order_release);
+  return 1;
+}
 
-  pthread_mutex_init(&individuals_mutex, NULL);
-  pthread_barrier_init(&generation_barrier, NULL, n_threads + 1);
+/* Sends the MIGRANTS best individuals to the next island, then lets each
+ * waiting migrant replace the current worst one. */
+void migrate(IslandArgs *args, Population *pop) {
+  int sent[MIGRANTS];
+  int n_sent = 0;
+  while (n_sent < MIGRANTS && n_sent < pop->n) {
+    int best = -1;
+    for (int i = 0; i < pop->n; ++i) {
+      int taken = 0;
+      for (int s = 0; s < n_sent; ++s)
+        taken |= sent[s] == i;
+      if (!taken && (best < 0 || pop->fitness[i] > pop->fitness[best]))
+        best = i;
+    }
+    sent[n_sent++] = best;
+    if (mailbox_push(args->outbox, pop, best))
+      args->sent++;
+    else
+      args->dropped++;
+  }
+
+  while (1) {
+    int worst = 0;
+    for (int i = 1; i < pop->n; ++i)
+      if (pop->fitness[i] < pop->fitness[worst])
+        worst = i;
+    if (!mailbox_pop(args->inbox, pop, worst))
+      break;
+    args->received++;
+  }
+}
+
+/* One island: evaluate, maybe migrate, breed, swap. Islands never wait on
+ * each other; the first one to hit the target flags the others to stop. */
+void *island_thread(void *arg) {
+  IslandArgs *args = (IslandArgs *)arg;
+  int n = args->end_index - args->start_index;
+  Population *pop = population_create(n, g_n_features);
+  Population *children = population_create(n, g_n_features);
+  init_features(pop, args->start_index);
+  uint64_t island_seed = crng_u64(g_seed, (uint64_t)args->id);
+
+  args->best_fitness = 0.0;
+  for (int k = 1; k <= g_total_generations && n > 0; ++k) {
+    if (atomic_load_explicit(&g_target_reached, memory_order_relaxed))
+      break;
+
+    g_fitness_batch(pop, 0, n);
+    double best = pop->fitness[0];
+    for (int i = 1; i < n; ++i)
+      if (pop->fitness[i] > best)
+        best = pop->fitness[i];
+    if (best > args->best_fitness || k == 1)
+      args->best_fitness = best;
+    args->generations = k;
+
+    if (g_has_target && best >= g_target &&
+        !atomic_exchange(&g_target_reached, 1)) {
+      clock_gettime(CLOCK_MONOTONIC, &g_target_time);
+      g_target_island = args->id;
+      g_target_generation = k;
+      break;
+    }
+
+    if (k % args->migrate_every == 0)
+      migrate(args, pop);
+
+    uint64_t key = crng_key(island_seed, k);
+    for (int i = 0; i < n; ++i)
+      breed(pop, children, i, key);
+
+    Population *evaluated = pop;
+    pop = children;
+    children = evaluated;
+  }
+
+  population_destroy(pop);
+  population_destroy(children);
+  return NULL;
+}
+
+TargetResult run_islands(int migrate_every) {
+  int n_islands = g_n_threads;
+  pthread_t threads[n_islands];
+  IslandArgs island_args[n_islands];
+  Mailbox *mailboxes = (Mailbox *)aligned_alloc(
+      CACHE_LINE, sizeof(Mailbox) * n_islands);
+  if (!mailboxes)
+    error("error aligned_alloc mailboxes");
+
+  for (int i = 0; i < n_islands; ++i) {
+    atomic_init(&mailboxes[i].head, 0);
+    atomic_init(&mailboxes[i].tail, 0);
+    mailboxes[i].slots = (double *)malloc(
+        (size_t)MAILBOX_SLOTS * (g_n_features + 1) * sizeof(double));
+    if (!mailboxes[i].slots)
+      error("error malloc mailbox");
+  }
+  atomic_init(&g_target_reached, 0);
+
+  clock_gettime(CLOCK_MONOTONIC, &g_run_start);
+  for (int i = 0; i < n_islands; ++i) {
+    memset(&island_args[i], 0, sizeof(IslandArgs));
+    island_args[i].id = i;
+    blas1_range(g_n_individuals, n_islands, i, &island_args[i].start_index,
+                &island_args[i].end_index);
+    island_args[i].migrate_every = migrate_every;
+    island_args[i].inbox = &mailboxes[i];
+    island_args[i].outbox = &mailboxes[(i + 1) % n_islands];
+    if (pthread_create(&threads[i], NULL, island_thread,
+                       (void *)&island_args[i]) != 0)
+      error("error pthread_create");
+  }
+  for (int i = 0; i < n_islands; ++i)
+    pthread_join(threads[i], NULL);
+
+  struct timespec t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+  println("Islas: %d, migracion cada %d generaciones", n_islands,
+          migrate_every);
+  for (int i = 0; i < n_islands; ++i)
+    println("  Isla %d: %d generaciones, mejor fitness %.2f, migrantes "
+            "enviados %ld, recibidos %ld, descartados %ld",
+            i, island_args[i].generations, island_args[i].best_fitness,
+            island_args[i].sent, island_args[i].received,
+            island_args[i].dropped);
+
+  TargetResult result = {0, 0, 0.0, elapsed_seconds(g_run_start, t_end)};
+  if (atomic_load(&g_target_reached)) {
+    result.reached = 1;
+    result.generation = g_target_generation;
+    result.seconds = elapsed_seconds(g_run_start, g_target_time);
+    println("  Objetivo alcanzado por la isla %d", g_target_island);
+  }
+
+  for (int i = 0; i < n_islands; ++i)
+    free(mailboxes[i].slots);
+  free(mailboxes);
+  return result;
+}
+
+/* Times one fitness pass over n individuals with n_features each, first as
+ * an array of structs scored one fitness_calc call at a time, then as SoA
+ * columns through g_fitness_batch. Single-threaded so only layout differs. */
+void bench_layouts(int n, int repetitions) {
+  static const int feature_counts[] = {2, 8, 64};
+  println("Fitness %s, %d individuos, %d repeticiones", fitness_kernel_name, n,
+          repetitions);
+
+  for (size_t c = 0; c < sizeof(feature_counts) / sizeof(feature_counts[0]);
+       ++c) {
+    int n_features = feature_counts[c];
+    uint64_t key = crng_key(g_seed, 0);
 
-  for (int i = 0; i < g_n_individuals; ++i) {
-    g_individuals[i].feature1 =
-        (double)rand() / RAND_MAX * MAX_POPULATION_CONST;
-    g_individuals[i].feature2 =
-        (double)rand() / RAND_MAX * MAX_POPULATION_CONST;
-    g_individuals[i].fitness = 0.0;
+    /* AoS record: fitness followed by the features. */
+    int record = n_features + 1;
+    double *aos = (double *)malloc((size_t)n * record * sizeof(double));
+    Population *soa = population_create(n, n_features);
+    if (!aos)
+      error("error malloc aos");
+    for (int i = 0; i < n; ++i) {
+      for (int f = 0; f < n_features; ++f) {
+        double value =
+            crng_uniform(key, (uint64_t)i * n_features + f) * MAX_POPULATION_CONST;
+        aos[(size_t)i * record + 1 + f] = value;
+        feature_column(soa, f)[i] = value;
+      }
+    }
+
+    struct timespec t_start, t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    for (int r = 0; r < repetitions; ++r)
+      for (int i = 0; i < n; ++i)
+        aos[(size_t)i * record] =
+            fitness_calc(&aos[(size_t)i * record + 1], n_features);
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    double aos_time = elapsed_seconds(t_start, t_end);
+
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    for (int r = 0; r < repetitions; ++r)
+      g_fitness_batch(soa, 0, n);
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    double soa_time = elapsed_seconds(t_start, t_end);
+
+    int mismatches = 0;
+    for (int i = 0; i < n; ++i)
+      mismatches += aos[(size_t)i * record] != soa->fitness[i];
+
+    double total = (double)n * repetitions;
+    println("  %2d features: AoS %.2f Mind/s, SoA %.2f Mind/s (%.2fx)%s",
+            n_features, total / aos_time / 1e6, total / soa_time / 1e6,
+            aos_time / soa_time, mismatches ? " DIFERENCIAS" : "");
+
+    free(aos);
+    population_destroy(soa);
   }
+}
+
+/* The barrier-synchronised model: every generation all workers meet twice
+ * and main reduces, ranks and prints. verbose = 0 keeps only the timing. */
+TargetResult run_synchronous(int verbose) {
+  int n_threads = g_n_threads;
+  g_rank = verbose;
+
+  g_individuals = population_create(g_n_individuals, g_n_features);
+  g_offspring = population_create(g_n_individuals, g_n_features);
+  if (g_elite == 0) {
+    g_ranking = (RankEntry *)malloc(g_n_individuals * sizeof(RankEntry));
+    g_rank_scratch = (RankEntry *)malloc(g_n_individuals * sizeof(RankEntry));
+    if (!g_ranking || !g_rank_scratch)
+      error("error malloc g_ranking");
+  }
+
+  pthread_barrier_init(&generation_barrier, NULL, n_threads + 1);
+  pthread_barrier_init(&worker_barrier, NULL, n_threads);
+
+  init_features(g_individuals, 0);
 
   pthread_t threads[n_threads];
   ThreadArgs thread_args[n_threads];
+  RankEntry *candidates = NULL;
+  if (g_elite > 0) {
+    candidates = (RankEntry *)malloc((size_t)n_threads * g_elite *
+                                     sizeof(RankEntry));
+    if (!candidates)
+      error("error malloc candidates");
+  }
 
-  int individuals_per_thread = g_n_individuals / n_threads;
-  int remainder = g_n_individuals % n_threads;
-  int current_index = 0;
+  int merge_rounds = 0;
+  for (int step = 1; step < n_threads; step *= 2)
+    merge_rounds++;
 
+  g_current_generation = 0;
   for (int i = 0; i < n_threads; ++i) {
-    thread_args[i].individual = g_individuals;
-    thread_args[i].start_index = current_index;
-    thread_args[i].end_index =
-        current_index + individuals_per_thread + (i < remainder ? 1 : 0);
+    blas1_range(g_n_individuals, n_threads, i, &thread_args[i].start_index,
+                &thread_args[i].end_index);
     thread_args[i].thread_id = i;
     thread_args[i].barrier = &generation_barrier;
     thread_args[i].current_generation = &g_current_generation;
     thread_args[i].total_generations = g_total_generations;
+    thread_args[i].heap = candidates ? candidates + (size_t)i * g_elite : NULL;
+    thread_args[i].heap_size = 0;
+    thread_args[i].best_fitness = 0.0;
+    thread_args[i].fitness_sum = 0.0;
+    thread_args[i].evaluated = 0;
 
     if (pthread_create(&threads[i], NULL, worker_thread,
                        (void *)&thread_args[i]) != 0)
       error("error pthread_create");
-
-    current_index = thread_args[i].end_index;
   }
 
+  TargetResult result = {0, 0, 0.0, 0.0};
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+
   for (int k = 1; k <= g_total_generations; ++k) {
     g_current_generation = k;
+    atomic_store(&g_eval_cursor, 0);
+    pthread_barrier_wait(&generation_barrier);
     pthread_barrier_wait(&generation_barrier);
 
-    pthread_mutex_lock(&individuals_mutex);
-    qsort(g_individuals, g_n_individuals, sizeof(Individual),
-          compare_individuals);
-    pthread_mutex_unlock(&individuals_mutex);
+    double best = 0.0, sum = 0.0;
+    for (int t = 0; t < n_threads; ++t) {
+      if (thread_args[t].end_index > thread_args[t].start_index &&
+          (t == 0 || thread_args[t].best_fitness > best))
+        best = thread_args[t].best_fitness;
+      sum += thread_args[t].fitness_sum;
+    }
+    if (g_has_target && best >= g_target) {
+      clock_gettime(CLOCK_MONOTONIC, &t_end);
+      result.reached = 1;
+      result.generation = k;
+      result.seconds = elapsed_seconds(t_start, t_end);
+    }
+
+    if (verbose) {
+      println("Generacion %d", k);
+      println("  Mejor fitness: %.2f, media: %.2f", best,
+              g_n_individuals > 0 ? sum / g_n_individuals : 0.0);
+      if (g_elite > 0) {
+        /* The heaps sit back to back in candidates; compact and rank them. */
+        int n_candidates = 0;
+        for (int t = 0; t < n_threads; ++t)
+          for (int h = 0; h < thread_args[t].heap_size; ++h)
+            candidates[n_candidates++] = thread_args[t].heap[h];
+        qsort(candidates, n_candidates, sizeof(RankEntry), compare_ranks);
+        for (int i = 0; i < n_candidates && i < g_elite; ++i)
+          print_individual(i + 1, g_individuals, candidates[i].index);
+      } else {
+        if (merge_rounds % 2 == 1) {
+          RankEntry *tmp = g_ranking;
+          g_ranking = g_rank_scratch;
+          g_rank_scratch = tmp;
+        }
+        for (int i = 0; i < g_n_individuals && i < SHOWN_INDIVIDUALS; ++i)
+          print_individual(i + 1, g_individuals, g_ranking[i].index);
+      }
+    }
 
-    println("Generacion %d", k);
-    for (int i = 0; i < g_n_individuals && i < 10; ++i)
-      println("  Individuo %d: F1=%.2f, F2=%.2f, Fitness=%.2f", i + 1,
-              g_individuals[i].feature1, g_individuals[i].feature2,
-              g_individuals[i].fitness);
+    Population *evaluated = g_individuals;
+    g_individuals = g_offspring;
+    g_offspring = evaluated;
 
-    pthread_barrier_wait(&generation_barrier);
+    if (result.reached)
+      break;
   }
 
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  result.total_seconds = elapsed_seconds(t_start, t_end);
+
   g_current_generation = g_total_generations + 1;
   pthread_barrier_wait(&generation_barrier);
 
   for (int i = 0; i < n_threads; ++i)
     pthread_join(threads[i], NULL);
 
-  pthread_mutex_destroy(&individuals_mutex);
+  if (verbose) {
+    fprintf(stderr, "Evaluados por hilo:");
+    for (int i = 0; i < n_threads; ++i)
+      fprintf(stderr, " %ld", thread_args[i].evaluated);
+    fprintf(stderr, "\n");
+  }
+
   pthread_barrier_destroy(&generation_barrier);
+  pthread_barrier_destroy(&worker_barrier);
+
+  population_destroy(g_individuals);
+  population_destroy(g_offspring);
+  free(g_ranking);
+  free(g_rank_scratch);
+  g_ranking = g_rank_scratch = NULL;
+  free(candidates);
+
+  return result;
+}
+
+void print_target(const char *model, TargetResult result) {
+  if (result.reached)
+    println("%s: objetivo %.2f alcanzado en la generacion %d, %.4f s "
+            "(total %.4f s)",
+            model, g_target, result.generation, result.seconds,
+            result.total_seconds);
+  else
+    println("%s: objetivo %.2f no alcanzado, total %.4f s", model, g_target,
+            result.total_seconds);
+}
+
+#define USAGE                                                                  \
+  "Usage: <n_individuals> <n_threads> <n_generations> [--seed=N] "            \
+  "[--elite=k] [--features=N] [--bench] [--islands] [--migrate=M] "           \
+  "[--target=F] [--fitness=pairs|costly] [--chunk=N] [--memo=entries]"
+
+int main(int argc, char *argv[]) {
+  if (argc < 4)
+    error(USAGE);
+
+  g_n_individuals = atoi(argv[1]);
+  int n_threads = atoi(argv[2]);
+  g_total_generations = atoi(argv[3]);
+  if (n_threads <= 0)
+    error("n_threads must be greater than 0");
+  g_n_threads = n_threads;
+  g_fitness_batch = fitness_pairs_batch;
+
+  int bench = 0;
+  int islands = 0;
+  int migrate_every = 10;
+  long memo_entries = 0;
+  g_seed = (uint64_t)time(NULL);
+  for (int i = 4; i < argc; ++i) {
+    if (strncmp(argv[i], "--seed=", 7) == 0)
+      g_seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--elite=", 8) == 0 && atoi(argv[i] + 8) > 0)
+      g_elite = atoi(argv[i] + 8);
+    else if (strncmp(argv[i], "--features=", 11) == 0 &&
+             atoi(argv[i] + 11) > 0)
+      g_n_features = atoi(argv[i] + 11);
+    else if (strcmp(argv[i], "--bench") == 0)
+      bench = 1;
+    else if (strcmp(argv[i], "--islands") == 0)
+      islands = 1;
+    else if (strncmp(argv[i], "--migrate=", 10) == 0 &&
+             atoi(argv[i] + 10) > 0)
+      migrate_every = atoi(argv[i] + 10);
+    else if (strcmp(argv[i], "--fitness=pairs") == 0)
+      g_fitness_batch = fitness_pairs_batch;
+    else if (strcmp(argv[i], "--fitness=costly") == 0)
+      g_fitness_batch = fitness_costly_batch;
+    else if (strncmp(argv[i], "--chunk=", 8) == 0 && atoi(argv[i] + 8) > 0)
+      g_chunk = atoi(argv[i] + 8);
+    else if (strncmp(argv[i], "--memo=", 7) == 0 && atol(argv[i] + 7) > 0)
+      memo_entries = atol(argv[i] + 7);
+    else if (strncmp(argv[i], "--target=", 9) == 0) {
+      g_has_target = 1;
+      g_target = atof(argv[i] + 9);
+    } else
+      error(USAGE);
+  }
+
+  if (bench) {
+    bench_layouts(g_n_individuals, g_total_generations > 0 ? g_total_generations : 1);
+    return EXIT_SUCCESS;
+  }
 
-  free(g_individuals);
+  if (memo_entries > 0) {
+    memo_init(&g_memo, memo_entries);
+    g_fitness_inner = g_fitness_batch;
+    g_fitness_batch = fitness_memo_batch;
+  }
+
+  if (islands) {
+    TargetResult island_result = run_islands(migrate_every);
+    if (g_has_target) {
+      /* The comparison run starts from an empty memo, not the islands'. */
+      if (memo_entries > 0)
+        memo_clear(&g_memo);
+      TargetResult sync_result = run_synchronous(0);
+      print_target("Modelo de islas", island_result);
+      print_target("Modelo sincrono", sync_result);
+    } else {
+      println("Tiempo total: %.4f s", island_result.total_seconds);
+    }
+    if (memo_entries > 0)
+      free(g_memo.slots);
+    return EXIT_SUCCESS;
+  }
+
+  TargetResult result = run_synchronous(1);
+  if (g_has_target)
+    print_target("Modelo sincrono", result);
+  fprintf(stderr, "Tiempo: %.4f s\n", result.total_seconds);
+  if (memo_entries > 0) {
+    long hits = atomic_load(&g_memo.hits), misses = atomic_load(&g_memo.misses);
+    fprintf(stderr, "Memo: %ld aciertos, %ld fallos (%.1f%%)\n", hits, misses,
+            hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+    free(g_memo.slots);
+  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,95 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+/* Header-only high dynamic range histogram for latencies in nanoseconds.
+ * Values below 2^HDR_SUB_BITS are counted exactly; above that every power
+ * of two is split into 2^(HDR_SUB_BITS - 1) equal buckets, so a recorded
+ * value is off by at most 1/64 (about 1.6%) at any magnitude and the
+ * whole table is a fixed array that can be recorded into without
+ * allocating. */
+
+#include <stdint.h>
+#include <string.h>
+
+#define HDR_SUB_BITS 7
+#define HDR_SUB_COUNT (1 << HDR_SUB_BITS)
+#define HDR_HALF_COUNT (HDR_SUB_COUNT / 2)
+#define HDR_BUCKETS (HDR_SUB_COUNT + (64 - HDR_SUB_BITS) * HDR_HALF_COUNT)
+
+typedef struct {
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  double sum;
+  uint64_t counts[HDR_BUCKETS];
+} HdrHistogram;
+
+static inline void hdr_init(HdrHistogram *h) {
+  memset(h, 0, sizeof(HdrHistogram));
+  h->min = UINT64_MAX;
+}
+
+static inline int hdr_index(uint64_t value) {
+  if (value < HDR_SUB_COUNT)
+    return (int)value;
+  int shift = 63 - __builtin_clzll(value) - (HDR_SUB_BITS - 1);
+  return HDR_SUB_COUNT + (shift - 1) * HDR_HALF_COUNT +
+         (int)((value >> shift) - HDR_HALF_COUNT);
+}
+
+/* Largest value that lands in bucket index. */
+static inline uint64_t hdr_bucket_max(int index) {
+  if (index < HDR_SUB_COUNT)
+    return (uint64_t)index;
+  int shift = (index - HDR_SUB_COUNT) / HDR_HALF_COUNT + 1;
+  uint64_t sub = (uint64_t)((index - HDR_SUB_COUNT) % HDR_HALF_COUNT) +
+                 HDR_HALF_COUNT;
+  return ((sub + 1) << shift) - 1;
+}
+
+static inline void hdr_record(HdrHistogram *h, uint64_t value) {
+  h->counts[hdr_index(value)]++;
+  h->count++;
+  h->sum += (double)value;
+  if (value < h->min)
+    h->min = value;
+  if (value > h->max)
+    h->max = value;
+}
+
+static inline void hdr_merge(HdrHistogram *dst, const HdrHistogram *src) {
+  for (int i = 0; i < HDR_BUCKETS; ++i)
+    dst->counts[i] += src->counts[i];
+  dst->count += src->count;
+  dst->sum += src->sum;
+  if (src->min < dst->min)
+    dst->min = src->min;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+/* Smallest bucket bound with at least percentile% of the values at or
+ * below it, clamped to the largest value actually recorded. */
+static inline uint64_t hdr_percentile(const HdrHistogram *h,
+                                      double percentile) {
+  if (h->count == 0)
+    return 0;
+  uint64_t rank = (uint64_t)(percentile / 100.0 * h->count + 0.5);
+  if (rank < 1)
+    rank = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < HDR_BUCKETS; ++i) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t bound = hdr_bucket_max(i);
+      return bound < h->max ? bound : h->max;
+    }
+  }
+  return h->max;
+}
+
+static inline double hdr_mean(const HdrHistogram *h) {
+  return h->count ? h->sum / h->count : 0.0;
+}
+
+#endif
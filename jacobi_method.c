@@ -3,6 +3,8 @@
 #include <pthread.h>
 #include <string.h>
 
+#include "blas1.h"
+
 int **g_current_matrix;
 int **g_next_matrix;
 int g_rows, g_cols;
@@ -144,24 +146,15 @@ int main(int argc, char* argv[]) {
     int inner_rows = g_rows - 2;
     if (inner_rows < 0) inner_rows = 0;
 
-    int rows_per_thread = inner_rows / n_threads;
-    int remainder = inner_rows % n_threads;
-
-    int current_row_for_threads = 1;
-
     for (int i = 0; i < n_threads; ++i) {
         thread_args[i].thread_id = i;
-        thread_args[i].start_row = current_row_for_threads;
-        thread_args[i].end_row = current_row_for_threads + rows_per_thread + (i < remainder ? 1 : 0);
-
-        if (thread_args[i].end_row > g_rows - 1) {
-            thread_args[i].end_row = g_rows - 1;
-        }
+        blas1_range(inner_rows, n_threads, i, &thread_args[i].start_row, &thread_args[i].end_row);
+        thread_args[i].start_row += 1;
+        thread_args[i].end_row += 1;
 
         if (pthread_create(&threads[i], NULL, worker_thread, (void*)&thread_args[i]) != 0) {
             error("pthread_create failed");
         }
-        current_row_for_threads = thread_args[i].end_row;
     }
 
     for (int t = 0; t < g_iterations; ++t) {
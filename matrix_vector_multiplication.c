@@ -1,6 +1,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -17,6 +18,25 @@ int no_more_work = 0;
 int rows_completed = 0;
 pthread_cond_t all_work_done_cond;
 
+#define CACHE_LINE 64
+
+int transposed_mode = 0;
+double *Bt;
+double *Ct;
+double **partials;
+int n_partials;
+pthread_barrier_t reduce_barrier;
+
+typedef struct {
+    int thread_id;
+    int start_row;
+    int end_row;
+} TransposeArgs;
+
+double elapsed_seconds(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
 void *multiply_rows_recycled(void *arg) {
     long thread_id = (long)arg;
     int current_row;
@@ -38,7 +58,8 @@ void *multiply_rows_recycled(void *arg) {
         
         pthread_mutex_unlock(&row_mutex);
 
-        printf("Hilo %ld procesando fila %d\n", thread_id, current_row);
+        if (!transposed_mode)
+            printf("Hilo %ld procesando fila %d\n", thread_id, current_row);
         C[current_row] = 0.0;
         for (int j = 0; j < n; j++) {
             C[current_row] += A[current_row][j] * B[j];
@@ -67,7 +88,80 @@ void *calculate_specific_component(void *arg) {
     pthread_exit(NULL);
 }
 
-int main() {
+/* Each thread scatters its band of rows into a private partial vector, then
+ * the partials are folded pairwise in log2(n_partials) barrier rounds. */
+void *multiply_transposed(void *arg) {
+    TransposeArgs *args = (TransposeArgs *)arg;
+    int id = args->thread_id;
+    double *partial = partials[id];
+
+    memset(partial, 0, n * sizeof(double));
+    for (int i = args->start_row; i < args->end_row; i++) {
+        const double *row = A[i];
+        double b = Bt[i];
+        for (int j = 0; j < n; j++) {
+            partial[j] += row[j] * b;
+        }
+    }
+
+    for (int stride = 1; stride < n_partials; stride <<= 1) {
+        pthread_barrier_wait(&reduce_barrier);
+        if (id % (2 * stride) == 0 && id + stride < n_partials) {
+            const double *other = partials[id + stride];
+            for (int j = 0; j < n; j++) {
+                partial[j] += other[j];
+            }
+        }
+    }
+    pthread_exit(NULL);
+}
+
+void run_transposed(int num_threads) {
+    n_partials = num_threads;
+    size_t padded = ((n * sizeof(double) + CACHE_LINE - 1) / CACHE_LINE) * CACHE_LINE;
+    if (padded == 0) padded = CACHE_LINE;
+
+    partials = (double **)malloc(num_threads * sizeof(double *));
+    for (int t = 0; t < num_threads; t++) {
+        partials[t] = (double *)aligned_alloc(CACHE_LINE, padded);
+    }
+
+    pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    TransposeArgs *args = (TransposeArgs *)malloc(num_threads * sizeof(TransposeArgs));
+    pthread_barrier_init(&reduce_barrier, NULL, num_threads);
+
+    int rows_per_thread = m / num_threads;
+    int remainder = m % num_threads;
+    int current_row = 0;
+
+    for (int t = 0; t < num_threads; t++) {
+        args[t].thread_id = t;
+        args[t].start_row = current_row;
+        args[t].end_row = current_row + rows_per_thread + (t < remainder ? 1 : 0);
+        pthread_create(&threads[t], NULL, multiply_transposed, (void *)&args[t]);
+        current_row = args[t].end_row;
+    }
+
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    memcpy(Ct, partials[0], n * sizeof(double));
+
+    pthread_barrier_destroy(&reduce_barrier);
+    for (int t = 0; t < num_threads; t++) {
+        free(partials[t]);
+    }
+    free(partials);
+    free(threads);
+    free(args);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--transpose") == 0) {
+        transposed_mode = 1;
+    }
+
     srand(time(NULL));
 
     printf("Ingrese el numero de filas (m) de la matriz A: ");
@@ -92,6 +186,14 @@ int main() {
         B[i] = (double)rand() / RAND_MAX * 10.0;
     }
 
+    if (transposed_mode) {
+        Bt = (double *)malloc(m * sizeof(double));
+        Ct = (double *)malloc(n * sizeof(double));
+        for (int i = 0; i < m; i++) {
+            Bt[i] = (double)rand() / RAND_MAX * 10.0;
+        }
+    }
+
     printf("Matriz A:\n");
     for (int i = 0; i < m; i++) {
         for (int j = 0; j < n; j++) {
@@ -105,6 +207,13 @@ int main() {
         printf("%.2f\n", B[i]);
     }
 
+    if (transposed_mode) {
+        printf("\nVector Bt:\n");
+        for (int i = 0; i < m; i++) {
+            printf("%.2f\n", Bt[i]);
+        }
+    }
+
     int num_threads;
     printf("\nIngrese el numero de hilos a crear: ");
     scanf("%d", &num_threads);
@@ -115,6 +224,9 @@ int main() {
 
     pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
 
+    struct timespec t_start, t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
     for (int i = 0; i < num_threads; i++) {
         pthread_create(&threads[i], NULL, multiply_rows_recycled, (void *)(long)i);
     }
@@ -142,6 +254,9 @@ int main() {
     }
     pthread_join(specific_thread, NULL);
 
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    double direct_time = elapsed_seconds(t_start, t_end);
+
     pthread_mutex_destroy(&row_mutex);
     pthread_cond_destroy(&work_cond);
     pthread_cond_destroy(&all_work_done_cond);
@@ -151,6 +266,26 @@ int main() {
         printf("C[%d] = %.2f\n", i, C[i]);
     }
 
+    if (transposed_mode) {
+        clock_gettime(CLOCK_MONOTONIC, &t_start);
+        run_transposed(num_threads);
+        clock_gettime(CLOCK_MONOTONIC, &t_end);
+        double transposed_time = elapsed_seconds(t_start, t_end);
+
+        printf("\nVector Resultante Ct = A^T * Bt:\n");
+        for (int j = 0; j < n; j++) {
+            printf("Ct[%d] = %.2f\n", j, Ct[j]);
+        }
+
+        double gflop = 2.0 * m * n / 1e9;
+        printf("\nA * B   : %.6f s (%.3f GFLOP/s)\n", direct_time, gflop / direct_time);
+        printf("A^T * Bt: %.6f s (%.3f GFLOP/s)\n", transposed_time, gflop / transposed_time);
+        printf("Relacion transpuesta / directa: %.2fx\n", transposed_time / direct_time);
+
+        free(Bt);
+        free(Ct);
+    }
+
     for (int i = 0; i < m; i++) {
         free(A[i]);
     }
@@ -1,180 +1,878 @@
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hdr_histogram.h"
+#include "request_mix.h"
 
-#define MAX_LINE 1024
-#define MAX_REQUESTS 250
-#define NO_CLASIFICADO -1
 #define BAJA 0
 #define URGENTE 1
 #define CRITICA 2
-#define EN_VERIFICACION 3
-#define N_THREADS 2
+#define N_CLASSES 3
+#define CACHE_LINE 64
+#define ARENA_CHUNK (1 << 20)
+#define ARENA_BIAS (1L << 40)
+#define QUEUE_CAPACITY 4096
+#define SPIN_LIMIT 256
+#define LANE_BATCH 64
+#define DISPATCH_BUFFER (1 << 16)
+#define DISPATCH_PENDING 1024
+#define MAX_RULES 64
+#define MAX_RULE_LINE 1024
+#define RULES_NO_STATE UINT16_MAX
 
 const char *palabras_criticas[] = {"servidor", "bloqueo", "caída"};
 const int n_palabras = sizeof(palabras_criticas) / sizeof(palabras_criticas[0]);
+const char *class_names[N_CLASSES] = {"BAJA", "URGENTE", "CRITICA"};
 
+/* All rule patterns compiled into one Aho-Corasick automaton with a full
+ * 256-way transition table, so a line is classified in a single byte-wise
+ * pass and UTF-8 words like "caída" are just byte strings. out[s] has bit p
+ * set when pattern p ends in state s. A line is BAJA unless every "require"
+ * and "prefix" pattern is found (prefixes only at offset 0); then it is
+ * CRITICA if any "critical" pattern is found and URGENTE otherwise. States
+ * are renumbered after compiling so that exactly those with outputs are
+ * >= out_base, which keeps the hot loop to one table load per byte. */
 typedef struct {
-  char buffer[MAX_LINE];
-  int status;
+  int n_states;
+  int capacity;
+  uint16_t *next;
+  int32_t *fail;
+  uint64_t *out;
+  int n_patterns;
+  int pattern_len[MAX_RULES];
+  uint64_t require_mask;
+  uint64_t critical_mask;
+  uint64_t anchored_mask;
+  uint32_t anchored_len;
+  uint32_t out_base;
+} RuleSet;
+
+/* Lines live in 1 MiB arena chunks filled straight from read(2); the
+ * pipeline only passes pointers into them. refs starts at ARENA_BIAS while
+ * the reader still owns the chunk and drops by one per written line, so
+ * whoever brings it to zero frees it. */
+typedef struct ArenaChunk {
+  atomic_long refs;
+  struct ArenaChunk *next;
+  size_t capacity;
+  char data[];
+} ArenaChunk;
+
+typedef struct {
+  const char *line;
+  uint32_t length;
+  ArenaChunk *chunk;
+  uint64_t seq;
+  uint64_t ingest_ns;
 } Request;
 
-Request requests[MAX_REQUESTS];
-int total_requests = 0;
+/* Bounded single-producer single-consumer ring. Each side keeps its own
+ * index and a cached copy of the other side's on its own cache line. */
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_size_t head;
+  size_t cached_tail;
+  _Alignas(CACHE_LINE) atomic_size_t tail;
+  size_t cached_head;
+  _Alignas(CACHE_LINE) atomic_int closed;
+  Request slots[QUEUE_CAPACITY];
+} SpscQueue;
+
+/* One lane per classifier thread. The reader deals the input to lanes in
+ * LANE_BATCH-line blocks and each lane owns every queue it writes, so each
+ * ring still has a single producer and a single consumer and no request
+ * status is ever shared between threads. */
+typedef struct {
+  SpscQueue input;
+  SpscQueue classes[N_CLASSES];
+} Lane;
+
+/* Without --out the writers keep line pointers per class and main prints
+ * the classic three-section report once the input ends, in input order. */
+typedef struct {
+  const char *line;
+  uint64_t seq;
+} LineRef;
 
-Request criticas[MAX_REQUESTS];
-int total_criticas = 0;
+typedef struct {
+  LineRef *lines;
+  long count;
+  long capacity;
+} LineList;
 
-Request urgentes[MAX_REQUESTS];
-int total_urgentes = 0;
+typedef struct {
+  int status;
+  FILE *output;
+  LineList list;
+} WriterArgs;
 
-Request baja_prioridad[MAX_REQUESTS];
-int total_baja = 0;
+/* --synthetic=N replaces the input with N request_mix.h lines, paced to
+ * --rate lines per second when it is positive. Lines are handed to the
+ * reader exactly like read(2) would, split at the end of the buffer when
+ * they do not fit. */
+typedef struct {
+  RequestMix mix;
+  long total;
+  long generated;
+  double rate;
+  uint64_t start_ns;
+  char pending[MIX_LINE_MAX + 1];
+  int pending_len;
+  int pending_off;
+} SynthSource;
 
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
-pthread_barrier_t barrier;
-int listo = 0;
+RuleSet rules;
+Lane *lanes;
+int n_lanes = 1;
+ArenaChunk *arena_chunks = NULL;
+int keep_lines = 1;
+long total_requests = 0;
+SynthSource synth;
+HdrHistogram dispatch_latency[N_CLASSES];
+
+/* Lines the dispatcher has formatted but not yet written, with what is
+ * needed to record their latency once write(2) returns. */
+typedef struct {
+  char data[DISPATCH_BUFFER];
+  size_t used;
+  int n_pending;
+  int status[DISPATCH_PENDING];
+  uint64_t ingest_ns[DISPATCH_PENDING];
+} DispatchBuffer;
 
 void error(const char *err) {
   perror(err);
   exit(EXIT_FAILURE);
 }
 
-void read_file(FILE *file) {
-  int temp_v_size;
-  fscanf(file, "%d\n", &temp_v_size);
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void queue_init(SpscQueue *q) {
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  atomic_init(&q->closed, 0);
+  q->cached_tail = 0;
+  q->cached_head = 0;
+}
+
+void backoff(int *spins) {
+  if (++*spins < SPIN_LIMIT)
+    return;
+  *spins = 0;
+  sched_yield();
+}
+
+int queue_try_push(SpscQueue *q, Request req) {
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  if (tail - q->cached_head == QUEUE_CAPACITY) {
+    q->cached_head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - q->cached_head == QUEUE_CAPACITY)
+      return 0;
+  }
+  q->slots[tail % QUEUE_CAPACITY] = req;
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+void queue_push(SpscQueue *q, Request req) {
+  int spins = 0;
+  while (!queue_try_push(q, req))
+    backoff(&spins);
+}
+
+int queue_try_pop(SpscQueue *q, Request *req) {
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  if (head == q->cached_tail) {
+    q->cached_tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == q->cached_tail)
+      return 0;
+  }
+  *req = q->slots[head % QUEUE_CAPACITY];
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return 1;
+}
+
+/* Returns 0 once the producer has closed the queue and it is drained. */
+int queue_pop(SpscQueue *q, Request *req) {
+  int spins = 0;
+  while (1) {
+    if (queue_try_pop(q, req))
+      return 1;
+    if (atomic_load_explicit(&q->closed, memory_order_acquire))
+      return queue_try_pop(q, req);
+    backoff(&spins);
+  }
+}
+
+void queue_close(SpscQueue *q) {
+  atomic_store_explicit(&q->closed, 1, memory_order_release);
+}
+
+ArenaChunk *arena_new(size_t capacity) {
+  ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + capacity);
+  if (!chunk)
+    error("error malloc arena chunk");
+  atomic_init(&chunk->refs, ARENA_BIAS);
+  chunk->capacity = capacity;
+  chunk->next = arena_chunks;
+  arena_chunks = chunk;
+  return chunk;
+}
+
+void arena_release(ArenaChunk *chunk, long refs) {
+  if (atomic_fetch_sub_explicit(&chunk->refs, refs, memory_order_acq_rel) ==
+      refs) {
+    /* Only chunks nobody keeps pointers to are released early. */
+    free(chunk);
+  }
+}
+
+ssize_t synth_read(SynthSource *src, char *buf, size_t capacity) {
+  size_t written = 0;
+  if (!src->start_ns)
+    src->start_ns = now_ns();
+  while (written < capacity) {
+    if (src->pending_off == src->pending_len) {
+      if (src->generated == src->total)
+        break;
+      if (src->rate > 0) {
+        uint64_t due =
+            src->start_ns + (uint64_t)(src->generated / src->rate * 1e9);
+        if (now_ns() < due) {
+          /* Hand over what is due now instead of batching ahead. */
+          if (written)
+            break;
+          struct timespec ts = {(time_t)(due / 1000000000ULL),
+                                (long)(due % 1000000000ULL)};
+          clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+      }
+      src->pending_len =
+          request_mix_line(&src->mix, src->generated++, src->pending);
+      src->pending[src->pending_len++] = '\n';
+      src->pending_off = 0;
+    }
+    size_t n = (size_t)(src->pending_len - src->pending_off);
+    if (n > capacity - written)
+      n = capacity - written;
+    memcpy(buf + written, src->pending + src->pending_off, n);
+    src->pending_off += (int)n;
+    written += n;
+  }
+  return (ssize_t)written;
+}
 
-  total_requests = temp_v_size;
+int is_header_line(const char *line) {
+  if (!*line)
+    return 0;
+  for (; *line; ++line)
+    if (*line < '0' || *line > '9')
+      return 0;
+  return 1;
+}
 
-  for (int i = 0; i < total_requests; ++i) {
-    if (fgets(requests[i].buffer, MAX_LINE, file) == NULL) {
+/* Splits the input into lines inside arena chunks. A line cut by the end of
+ * a chunk is moved to the start of the next one, which grows when a single
+ * line does not fit. The old "<count>" header line is skipped. Requests
+ * are stamped with the time the read that delivered them returned. */
+void *reader_thread(void *arg) {
+  int fd = (int)(intptr_t)arg;
+  ArenaChunk *chunk = arena_new(ARENA_CHUNK);
+  size_t line_start = 0, filled = 0;
+  long emitted = 0;
+  int first_line = 1;
+  uint64_t seq = 0;
+
+  while (1) {
+    if (filled == chunk->capacity) {
+      size_t partial = filled - line_start;
+      size_t capacity = partial * 2 > ARENA_CHUNK ? partial * 2 : ARENA_CHUNK;
+      ArenaChunk *next = arena_new(capacity);
+      memcpy(next->data, chunk->data + line_start, partial);
+      if (!keep_lines)
+        arena_release(chunk, ARENA_BIAS - emitted);
+      chunk = next;
+      line_start = 0;
+      filled = partial;
+      emitted = 0;
+    }
+
+    ssize_t n = synth.total
+                    ? synth_read(&synth, chunk->data + filled,
+                                 chunk->capacity - filled)
+                    : read(fd, chunk->data + filled, chunk->capacity - filled);
+    if (n < 0)
+      error("error read");
+    uint64_t ingest_ns = now_ns();
+    size_t scan = filled;
+    filled += (size_t)n;
+    if (n == 0 && line_start < filled) {
+      /* Last line without a newline. A chunk is never full before a read,
+       * so there is room to terminate it. */
+      chunk->data[filled++] = '\n';
+    }
+
+    char *newline;
+    while ((newline = memchr(chunk->data + scan, '\n', filled - scan))) {
+      size_t end = (size_t)(newline - chunk->data);
+      *newline = '\0';
+      Request req = {chunk->data + line_start, (uint32_t)(end - line_start),
+                     chunk, seq, ingest_ns};
+      if (!(first_line && is_header_line(req.line))) {
+        queue_push(&lanes[seq / LANE_BATCH % n_lanes].input, req);
+        seq++;
+        emitted++;
+        total_requests++;
+      }
+      first_line = 0;
+      line_start = scan = end + 1;
+    }
+
+    if (n == 0)
       break;
+  }
+
+  for (int l = 0; l < n_lanes; ++l)
+    queue_close(&lanes[l].input);
+  if (!keep_lines)
+    arena_release(chunk, ARENA_BIAS - emitted);
+  return NULL;
+}
+
+int rules_new_state(RuleSet *rs) {
+  if (rs->n_states == rs->capacity) {
+    rs->capacity = rs->capacity ? rs->capacity * 2 : 64;
+    rs->next = realloc(rs->next, (size_t)rs->capacity * 256 * sizeof(uint16_t));
+    rs->fail = realloc(rs->fail, (size_t)rs->capacity * sizeof(int32_t));
+    rs->out = realloc(rs->out, (size_t)rs->capacity * sizeof(uint64_t));
+    if (!rs->next || !rs->fail || !rs->out)
+      error("error realloc rules");
+  }
+  if (rs->n_states == RULES_NO_STATE)
+    error("rules need too many states");
+  int state = rs->n_states++;
+  for (int c = 0; c < 256; ++c)
+    rs->next[(size_t)state * 256 + c] = RULES_NO_STATE;
+  rs->fail[state] = 0;
+  rs->out[state] = 0;
+  return state;
+}
+
+void rules_add(RuleSet *rs, const char *kind, const char *pattern) {
+  size_t len = strlen(pattern);
+  if (len == 0)
+    return;
+  if (rs->n_patterns == MAX_RULES)
+    error("too many rules");
+  int id = rs->n_patterns++;
+  uint64_t bit = (uint64_t)1 << id;
+  if (strcmp(kind, "require") == 0)
+    rs->require_mask |= bit;
+  else if (strcmp(kind, "prefix") == 0) {
+    rs->require_mask |= bit;
+    rs->anchored_mask |= bit;
+    if (len > rs->anchored_len)
+      rs->anchored_len = (uint32_t)len;
+  }
+  else if (strcmp(kind, "critical") == 0)
+    rs->critical_mask |= bit;
+  else
+    error("unknown rule kind");
+  rs->pattern_len[id] = (int)len;
+
+  int state = 0;
+  for (size_t i = 0; i < len; ++i) {
+    uint16_t *slot = &rs->next[(size_t)state * 256 + (unsigned char)pattern[i]];
+    if (*slot == RULES_NO_STATE) {
+      int child = rules_new_state(rs);
+      /* rules_new_state may move next; look the slot up again. */
+      slot = &rs->next[(size_t)state * 256 + (unsigned char)pattern[i]];
+      *slot = child;
     }
-    size_t len = strlen(requests[i].buffer);
-    if (len > 0 && requests[i].buffer[len - 1] == '\n') {
-      requests[i].buffer[len - 1] = '\0';
+    state = *slot;
+  }
+  rs->out[state] |= bit;
+}
+
+/* Breadth-first over the trie: sets failure links, merges their outputs and
+ * fills every missing transition, turning the trie into a DFA. */
+void rules_compile(RuleSet *rs) {
+  int32_t *queue = malloc((size_t)rs->n_states * sizeof(int32_t));
+  if (!queue)
+    error("error malloc rules queue");
+  int head = 0, tail = 0;
+  for (int c = 0; c < 256; ++c) {
+    int32_t child = rs->next[c];
+    if (child == RULES_NO_STATE) {
+      rs->next[c] = 0;
+    } else {
+      rs->fail[child] = 0;
+      queue[tail++] = child;
     }
-    requests[i].status = NO_CLASIFICADO;
+  }
+  while (head < tail) {
+    int32_t state = queue[head++];
+    for (int c = 0; c < 256; ++c) {
+      uint16_t *slot = &rs->next[(size_t)state * 256 + c];
+      uint16_t fallback = rs->next[(size_t)rs->fail[state] * 256 + c];
+      if (*slot == RULES_NO_STATE) {
+        *slot = fallback;
+      } else {
+        rs->fail[*slot] = fallback;
+        rs->out[*slot] |= rs->out[fallback];
+        queue[tail++] = *slot;
+      }
+    }
+  }
+  free(queue);
+
+  uint16_t *renumber = malloc((size_t)rs->n_states * sizeof(uint16_t));
+  uint16_t *next = malloc((size_t)rs->n_states * 256 * sizeof(uint16_t));
+  uint64_t *out = malloc((size_t)rs->n_states * sizeof(uint64_t));
+  if (!renumber || !next || !out)
+    error("error malloc rules");
+  uint32_t id = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1)
+      rs->out_base = id;
+    for (int state = 0; state < rs->n_states; ++state)
+      if ((rs->out[state] != 0) == pass)
+        renumber[state] = (uint16_t)id++;
+  }
+  for (int state = 0; state < rs->n_states; ++state) {
+    for (int c = 0; c < 256; ++c)
+      next[(size_t)renumber[state] * 256 + c] =
+          renumber[rs->next[(size_t)state * 256 + c]];
+    out[renumber[state]] = rs->out[state];
+  }
+  free(rs->next);
+  free(rs->out);
+  free(renumber);
+  rs->next = next;
+  rs->out = out;
+}
+
+void rules_default(RuleSet *rs) {
+  rules_new_state(rs);
+  rules_add(rs, "prefix", "REQ:");
+  rules_add(rs, "require", ";");
+  rules_add(rs, "require", "URGENTE");
+  for (int j = 0; j < n_palabras; ++j)
+    rules_add(rs, "critical", palabras_criticas[j]);
+  rules_compile(rs);
+}
+
+/* One rule per line, "<kind> <pattern>" with kind prefix, require or
+ * critical; the pattern is the rest of the line. '#' starts a comment line. */
+void rules_load(RuleSet *rs, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    error("error opening rules file");
+  rules_new_state(rs);
+  char line[MAX_RULE_LINE];
+  while (fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+    char *space = strchr(line, ' ');
+    if (!space)
+      error("rule without pattern");
+    *space = '\0';
+    rules_add(rs, line, space + 1);
   }
   fclose(file);
+  rules_compile(rs);
+}
+
+void rules_free(RuleSet *rs) {
+  free(rs->next);
+  free(rs->fail);
+  free(rs->out);
 }
 
-void *thread_worker(void *arg) {
-  int thread_id = (int)(intptr_t)arg;
+int classify(const RuleSet *rs, const char *line, uint32_t length) {
+  const uint16_t *next = rs->next;
+  uint64_t found = 0;
+  uint32_t state = 0;
+  uint32_t i = 0;
 
-  pthread_mutex_lock(&mutex);
-  while (!listo) {
-    pthread_cond_wait(&cond, &mutex);
+  /* Prefixes can only match within the first anchored_len bytes. */
+  uint32_t anchored_end = length < rs->anchored_len ? length : rs->anchored_len;
+  for (; i < anchored_end; ++i) {
+    state = next[(size_t)state * 256 + (unsigned char)line[i]];
+    if (state < rs->out_base)
+      continue;
+    uint64_t hits = rs->out[state];
+    for (uint64_t anchored = hits & rs->anchored_mask; anchored;
+         anchored &= anchored - 1) {
+      int id = __builtin_ctzll(anchored);
+      if ((uint32_t)rs->pattern_len[id] != i + 1)
+        hits &= ~((uint64_t)1 << id);
+    }
+    found |= hits;
   }
-  pthread_mutex_unlock(&mutex);
+  if ((found & rs->anchored_mask) != rs->anchored_mask)
+    return BAJA;
 
-  if (thread_id == 0) {
-    for (int i = 0; i < total_requests; ++i) {
-      pthread_mutex_lock(&mutex);
-      if (requests[i].status == NO_CLASIFICADO) {
-        if (strncmp(requests[i].buffer, "REQ:", 4) == 0 &&
-            strchr(requests[i].buffer, ';') != NULL) {
-          if (strstr(requests[i].buffer, "URGENTE")) {
-            requests[i].status = EN_VERIFICACION;
-          } else {
-            baja_prioridad[total_baja++] = requests[i];
-            requests[i].status = BAJA;
-          }
+  uint64_t floating = ~rs->anchored_mask;
+  for (; i < length; ++i) {
+    state = next[(size_t)state * 256 + (unsigned char)line[i]];
+    if (state < rs->out_base)
+      continue;
+    found |= rs->out[state] & floating;
+    /* Nothing later in the line can change a settled CRITICA. */
+    if ((found & rs->require_mask) == rs->require_mask &&
+        (found & rs->critical_mask || !rs->critical_mask))
+      break;
+  }
+  if ((found & rs->require_mask) != rs->require_mask)
+    return BAJA;
+  return (found & rs->critical_mask) ? CRITICA : URGENTE;
+}
+
+void *classify_thread(void *arg) {
+  Lane *lane = (Lane *)arg;
+  Request req;
+  while (queue_pop(&lane->input, &req))
+    queue_push(&lane->classes[classify(&rules, req.line, req.length)], req);
+  for (int c = 0; c < N_CLASSES; ++c)
+    queue_close(&lane->classes[c]);
+  return NULL;
+}
+
+void write_request(WriterArgs *args, Request req) {
+  if (args->output) {
+    fwrite(req.line, 1, req.length, args->output);
+    fputc('\n', args->output);
+    arena_release(req.chunk, 1);
+    return;
+  }
+  LineList *list = &args->list;
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 1024;
+    list->lines = realloc(list->lines, list->capacity * sizeof(LineRef));
+    if (!list->lines)
+      error("error realloc line list");
+  }
+  list->lines[list->count++] = (LineRef){req.line, req.seq};
+}
+
+/* Drains this class's queue in every lane; lanes that fall behind never
+ * hold the others back, so streamed output is ordered per lane only. */
+void *writer_thread(void *arg) {
+  WriterArgs *args = (WriterArgs *)arg;
+  int open_lanes = n_lanes;
+  int done[n_lanes];
+  memset(done, 0, sizeof(done));
+  int spins = 0;
+
+  while (open_lanes > 0) {
+    int progress = 0;
+    for (int l = 0; l < n_lanes; ++l) {
+      if (done[l])
+        continue;
+      SpscQueue *q = &lanes[l].classes[args->status];
+      Request req;
+      int popped = 0;
+      while (popped < LANE_BATCH && queue_try_pop(q, &req)) {
+        write_request(args, req);
+        popped++;
+      }
+      if (!popped && atomic_load_explicit(&q->closed, memory_order_acquire)) {
+        /* Closed: one last look picks up anything pushed before closing. */
+        if (queue_try_pop(q, &req)) {
+          write_request(args, req);
+          popped = 1;
         } else {
-          baja_prioridad[total_baja++] = requests[i];
-          requests[i].status = BAJA;
+          done[l] = 1;
+          open_lanes--;
         }
       }
-      pthread_mutex_unlock(&mutex);
+      progress |= popped;
     }
+    if (!progress)
+      backoff(&spins);
   }
+  if (args->output)
+    fflush(args->output);
+  return NULL;
+}
 
-  pthread_barrier_wait(&barrier);
-
-  if (thread_id == 1) {
-    for (int i = 0; i < total_requests; ++i) {
-      pthread_mutex_lock(&mutex);
-      if (requests[i].status == EN_VERIFICACION) {
-        int es_critica = 0;
-        for (int j = 0; j < n_palabras; ++j) {
-          if (strstr(requests[i].buffer, palabras_criticas[j])) {
-            es_critica = 1;
-            break;
-          }
-        }
-        if (es_critica) {
-          criticas[total_criticas++] = requests[i];
-          requests[i].status = CRITICA;
-        } else {
-          urgentes[total_urgentes++] = requests[i];
-          requests[i].status = URGENTE;
-        }
+/* --dispatch replaces the three writers with one thread that emits each
+ * request as soon as it is classified, to stdout as "<CLASE>\t<line>". The
+ * lanes' class rings form a multi-level priority queue of references into
+ * the arena: every pop takes the highest non-empty level, rotating over
+ * lanes within it, so a CRITICA request never waits behind URGENTE or BAJA
+ * ones. Latency is recorded per level from ingestion to the write(2) that
+ * emits the line, which happens right after any CRITICA line, when the
+ * buffer fills and whenever the queues run dry. */
+int priority_pop(Request *req, int *status, int *next_lane) {
+  for (int c = CRITICA; c >= BAJA; --c) {
+    for (int k = 0; k < n_lanes; ++k) {
+      int l = (*next_lane + k) % n_lanes;
+      if (queue_try_pop(&lanes[l].classes[c], req)) {
+        *status = c;
+        *next_lane = (l + 1) % n_lanes;
+        return 1;
       }
-      pthread_mutex_unlock(&mutex);
     }
   }
+  return 0;
+}
 
-  pthread_exit(NULL);
+int lanes_closed(void) {
+  for (int l = 0; l < n_lanes; ++l)
+    for (int c = 0; c < N_CLASSES; ++c)
+      if (!atomic_load_explicit(&lanes[l].classes[c].closed,
+                                memory_order_acquire))
+        return 0;
+  return 1;
+}
+
+void dispatch_flush(DispatchBuffer *out) {
+  const char *data = out->data;
+  size_t length = out->used;
+  while (length > 0) {
+    ssize_t n = write(STDOUT_FILENO, data, length);
+    if (n < 0)
+      error("error write");
+    data += n;
+    length -= (size_t)n;
+  }
+  uint64_t t = now_ns();
+  for (int i = 0; i < out->n_pending; ++i)
+    hdr_record(&dispatch_latency[out->status[i]], t - out->ingest_ns[i]);
+  out->used = 0;
+  out->n_pending = 0;
+}
+
+void dispatch_line(DispatchBuffer *out, int status, Request req) {
+  size_t length = strlen(class_names[status]) + 1 + req.length + 1;
+  if (out->used + length > DISPATCH_BUFFER ||
+      out->n_pending == DISPATCH_PENDING)
+    dispatch_flush(out);
+  if (length > DISPATCH_BUFFER)
+    error("error line too long");
+  char *p = out->data + out->used;
+  size_t name = strlen(class_names[status]);
+  memcpy(p, class_names[status], name);
+  p[name] = '\t';
+  memcpy(p + name + 1, req.line, req.length);
+  p[length - 1] = '\n';
+  out->used += length;
+  out->status[out->n_pending] = status;
+  out->ingest_ns[out->n_pending++] = req.ingest_ns;
+  if (status == CRITICA)
+    dispatch_flush(out);
+}
+
+void *dispatch_thread(void *arg) {
+  (void)arg;
+  static DispatchBuffer out;
+  int next_lane = 0, spins = 0, closed = 0;
+  Request req;
+  int status;
+
+  while (1) {
+    if (priority_pop(&req, &status, &next_lane)) {
+      dispatch_line(&out, status, req);
+      arena_release(req.chunk, 1);
+      continue;
+    }
+    /* Everything pushed before the last close is seen by one more scan. */
+    if (closed)
+      break;
+    dispatch_flush(&out);
+    closed = lanes_closed();
+    if (!closed)
+      backoff(&spins);
+  }
+  dispatch_flush(&out);
   return NULL;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc != 2)
-    error("Usage: <filename>");
+void print_latency(void) {
+  for (int c = CRITICA; c >= BAJA; --c) {
+    const HdrHistogram *h = &dispatch_latency[c];
+    fprintf(stderr,
+            "Latencia %-8s %9llu solicitudes  p50 %9.1f us  p99 %9.1f us  "
+            "max %9.1f us\n",
+            class_names[c], (unsigned long long)h->count,
+            hdr_percentile(h, 50.0) / 1e3, hdr_percentile(h, 99.0) / 1e3,
+            h->count ? h->max / 1e3 : 0.0);
+  }
+}
 
-  char *filename = argv[1];
-  FILE *file = fopen(filename, "r");
-  if (!file)
-    error("error opening file main");
+int compare_line_refs(const void *a, const void *b) {
+  uint64_t sa = ((const LineRef *)a)->seq, sb = ((const LineRef *)b)->seq;
+  return (sa > sb) - (sa < sb);
+}
 
-  pthread_t threads[N_THREADS];
+void print_section(const char *title, const char *empty, LineList *list) {
+  printf("\n[%s]\n", title);
+  if (list->count == 0) {
+    printf("%s\n", empty);
+    return;
+  }
+  /* Each lane delivered in order; restore the global input order. */
+  if (n_lanes > 1)
+    qsort(list->lines, list->count, sizeof(LineRef), compare_line_refs);
+  for (long i = 0; i < list->count; ++i)
+    printf("%s\n", list->lines[i].line);
+}
 
-  pthread_barrier_init(&barrier, NULL, N_THREADS );
+#define USAGE                                                                  \
+  "Usage: [<filename>|-] [--out=prefix|--dispatch] [--lanes=N] "               \
+  "[--rules=file] [--synthetic=N] [--rate=lines_per_s] "                       \
+  "[--mix=critical,urgent,invalid]"
 
-  for (int i = 0; i < N_THREADS; ++i) {
-    if (pthread_create(&threads[i], NULL, thread_worker, (void *)(intptr_t)i) !=
-        0)
-      error("thread creation");
+int main(int argc, char *argv[]) {
+  const char *filename = NULL;
+  const char *out_prefix = NULL;
+  const char *rules_path = NULL;
+  int dispatch = 0;
+  double critical = 0.05, urgent = 0.25, invalid = 0.10;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--out=", 6) == 0)
+      out_prefix = argv[i] + 6;
+    else if (strncmp(argv[i], "--lanes=", 8) == 0 && atoi(argv[i] + 8) > 0)
+      n_lanes = atoi(argv[i] + 8);
+    else if (strncmp(argv[i], "--rules=", 8) == 0)
+      rules_path = argv[i] + 8;
+    else if (strcmp(argv[i], "--dispatch") == 0)
+      dispatch = 1;
+    else if (strncmp(argv[i], "--synthetic=", 12) == 0 &&
+             atol(argv[i] + 12) > 0)
+      synth.total = atol(argv[i] + 12);
+    else if (strncmp(argv[i], "--rate=", 7) == 0)
+      synth.rate = atof(argv[i] + 7);
+    else if (strncmp(argv[i], "--mix=", 6) == 0) {
+      if (sscanf(argv[i] + 6, "%lf,%lf,%lf", &critical, &urgent, &invalid) !=
+          3)
+        error(USAGE);
+    }
+    else if (!filename)
+      filename = argv[i];
+    else
+      error(USAGE);
   }
+  if ((dispatch && out_prefix) || (synth.total && filename))
+    error(USAGE);
+  request_mix_init(&synth.mix, critical, urgent, invalid, 42);
 
-  read_file(file);
+  if (rules_path)
+    rules_load(&rules, rules_path);
+  else
+    rules_default(&rules);
 
-  listo = 1;
-  pthread_cond_broadcast(&cond);
+  int fd = STDIN_FILENO;
+  FILE *file = NULL;
+  if (!synth.total && filename && strcmp(filename, "-") != 0) {
+    file = fopen(filename, "r");
+    if (!file)
+      error("error opening file main");
+    fd = fileno(file);
+  }
 
-  for (int i = 0; i < N_THREADS; ++i)
-    pthread_join(threads[i], NULL);
+  static const char *suffixes[N_CLASSES] = {"baja", "urgentes", "criticas"};
+  WriterArgs writer_args[N_CLASSES];
+  keep_lines = out_prefix == NULL && !dispatch;
+  for (int c = 0; c < N_CLASSES; ++c) {
+    memset(&writer_args[c], 0, sizeof(WriterArgs));
+    writer_args[c].status = c;
+    if (out_prefix) {
+      char path[4096];
+      snprintf(path, sizeof(path), "%s.%s", out_prefix, suffixes[c]);
+      writer_args[c].output = fopen(path, "w");
+      if (!writer_args[c].output)
+        error("error opening output file");
+      setvbuf(writer_args[c].output, NULL, _IOFBF, 1 << 16);
+    }
+  }
 
-  printf("\n[CRÍTICAS]\n");
-  if (total_criticas == 0) {
-    printf("No hay solicitudes críticas.\n");
-  } else {
-    for (int i = 0; i < total_criticas; ++i)
-      printf("%s\n", criticas[i].buffer);
+  lanes = (Lane *)aligned_alloc(CACHE_LINE, n_lanes * sizeof(Lane));
+  if (!lanes)
+    error("error aligned_alloc lanes");
+  for (int l = 0; l < n_lanes; ++l) {
+    queue_init(&lanes[l].input);
+    for (int c = 0; c < N_CLASSES; ++c)
+      queue_init(&lanes[l].classes[c]);
   }
 
-  printf("\n[URGENTES]\n");
-  if (total_urgentes == 0) {
-    printf("No hay solicitudes urgentes.\n");
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+  pthread_t reader, classifiers[n_lanes], writers[N_CLASSES], dispatcher;
+  if (pthread_create(&reader, NULL, reader_thread, (void *)(intptr_t)fd) != 0)
+    error("thread creation");
+  for (int l = 0; l < n_lanes; ++l)
+    if (pthread_create(&classifiers[l], NULL, classify_thread,
+                       (void *)&lanes[l]) != 0)
+      error("thread creation");
+  if (dispatch) {
+    for (int c = 0; c < N_CLASSES; ++c)
+      hdr_init(&dispatch_latency[c]);
+    if (pthread_create(&dispatcher, NULL, dispatch_thread, NULL) != 0)
+      error("thread creation");
   } else {
-    for (int i = 0; i < total_urgentes; ++i)
-      printf("%s\n", urgentes[i].buffer);
+    for (int c = 0; c < N_CLASSES; ++c)
+      if (pthread_create(&writers[c], NULL, writer_thread,
+                         (void *)&writer_args[c]) != 0)
+        error("thread creation");
   }
 
-  printf("\n[BAJA_PRIORIDAD]\n");
-  if (total_baja == 0) {
-    printf("No hay solicitudes de baja prioridad.\n");
-  } else {
-    for (int i = 0; i < total_baja; ++i)
-      printf("%s\n", baja_prioridad[i].buffer);
+  pthread_join(reader, NULL);
+  for (int l = 0; l < n_lanes; ++l)
+    pthread_join(classifiers[l], NULL);
+  if (dispatch)
+    pthread_join(dispatcher, NULL);
+  else
+    for (int c = 0; c < N_CLASSES; ++c)
+      pthread_join(writers[c], NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double seconds = (t_end.tv_sec - t_start.tv_sec) +
+                   (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
+  if (keep_lines) {
+    print_section("CRÍTICAS", "No hay solicitudes críticas.",
+                  &writer_args[CRITICA].list);
+    print_section("URGENTES", "No hay solicitudes urgentes.",
+                  &writer_args[URGENTE].list);
+    print_section("BAJA_PRIORIDAD", "No hay solicitudes de baja prioridad.",
+                  &writer_args[BAJA].list);
+    while (arena_chunks) {
+      ArenaChunk *next = arena_chunks->next;
+      free(arena_chunks);
+      arena_chunks = next;
+    }
   }
 
-  pthread_barrier_destroy(&barrier);
-  pthread_mutex_destroy(&mutex);
+  fprintf(stderr, "%ld solicitudes en %.3f s (%.2f M/s)\n", total_requests,
+          seconds, seconds > 0 ? total_requests / seconds / 1e6 : 0.0);
+  if (dispatch)
+    print_latency();
+
+  for (int c = 0; c < N_CLASSES; ++c) {
+    if (writer_args[c].output)
+      fclose(writer_args[c].output);
+    free(writer_args[c].list.lines);
+  }
+  if (file)
+    fclose(file);
+  free(lanes);
+  rules_free(&rules);
 
   return EXIT_SUCCESS;
 }
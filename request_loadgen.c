@@ -0,0 +1,313 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hdr_histogram.h"
+#include "request_mix.h"
+
+#define BAJA 0
+#define URGENTE 1
+#define CRITICA 2
+#define N_CLASSES 3
+#define ALL_CLASSES N_CLASSES
+#define MAX_RATES 32
+#define SEND_BATCH 256
+#define RECV_BUFFER (1 << 16)
+
+/* Drives request_classification --dispatch: a sender thread writes
+ * request_mix.h lines at a target rate into the classifier's stdin over a
+ * pipe or a Unix socket pair, and main reads the "<CLASE>\t<line>" stream
+ * it emits. Latency is emission read time minus the time the line was
+ * written, per class and overall, and each target rate is one fresh
+ * classifier run and one group of CSV rows. */
+const char *class_names[N_CLASSES + 1] = {"BAJA", "URGENTE", "CRITICA",
+                                          "TODAS"};
+
+typedef struct {
+  int fd;
+  double rate;
+} SenderArgs;
+
+RequestMix mix;
+long n_requests = 100000;
+_Atomic uint64_t *send_ns;
+HdrHistogram latency[N_CLASSES + 1];
+long received = 0;
+long unexpected = 0;
+
+void error(const char *err) {
+  perror(err);
+  exit(EXIT_FAILURE);
+}
+
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void sleep_until(uint64_t deadline_ns) {
+  struct timespec ts = {(time_t)(deadline_ns / 1000000000ULL),
+                        (long)(deadline_ns % 1000000000ULL)};
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+void write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n < 0)
+      error("error write");
+    data += n;
+    length -= (size_t)n;
+  }
+}
+
+/* Class the default rules must give line i. */
+int expected_class(uint64_t i) {
+  switch (request_mix_kind(&mix, i)) {
+  case MIX_CRITICAL:
+    return CRITICA;
+  case MIX_URGENT:
+    return URGENTE;
+  default:
+    return BAJA;
+  }
+}
+
+/* Writes every line that is due in one write(2), up to SEND_BATCH, and
+ * stamps them all with the time just before it. A rate of 0 sends as fast
+ * as the classifier takes them. */
+void *sender_thread(void *arg) {
+  SenderArgs *args = (SenderArgs *)arg;
+  static char buffer[SEND_BATCH * (MIX_LINE_MAX + 1)];
+  uint64_t start = now_ns();
+  long i = 0;
+
+  while (i < n_requests) {
+    long due = n_requests;
+    if (args->rate > 0) {
+      due = (long)((now_ns() - start) / 1e9 * args->rate) + 1;
+      if (due > n_requests)
+        due = n_requests;
+      if (due <= i) {
+        sleep_until(start + (uint64_t)(i / args->rate * 1e9));
+        continue;
+      }
+    }
+    size_t length = 0;
+    long first = i;
+    for (; i < due && i - first < SEND_BATCH; ++i) {
+      length += (size_t)request_mix_line(&mix, (uint64_t)i, buffer + length);
+      buffer[length++] = '\n';
+    }
+    uint64_t t = now_ns();
+    for (long k = first; k < i; ++k)
+      atomic_store_explicit(&send_ns[k], t, memory_order_relaxed);
+    write_all(args->fd, buffer, length);
+  }
+  close(args->fd);
+  return NULL;
+}
+
+void record_line(const char *line, uint64_t t) {
+  const char *tab = strchr(line, '\t');
+  if (!tab)
+    return;
+  int status = -1;
+  for (int c = 0; c < N_CLASSES; ++c)
+    if ((size_t)(tab - line) == strlen(class_names[c]) &&
+        strncmp(line, class_names[c], (size_t)(tab - line)) == 0)
+      status = c;
+  long long id = request_mix_id(tab + 1);
+  if (status < 0 || id < 0 || id >= n_requests)
+    return;
+
+  uint64_t sent = atomic_load_explicit(&send_ns[id], memory_order_relaxed);
+  uint64_t value = t > sent ? t - sent : 0;
+  hdr_record(&latency[status], value);
+  hdr_record(&latency[ALL_CLASSES], value);
+  received++;
+  if (status != expected_class((uint64_t)id))
+    unexpected++;
+}
+
+/* Reads the dispatch stream until the classifier exits, stamping every
+ * line with the time the read that returned it finished. */
+void receive(int fd) {
+  static char buffer[RECV_BUFFER + 1];
+  size_t filled = 0;
+  while (1) {
+    ssize_t n = read(fd, buffer + filled, RECV_BUFFER - filled);
+    if (n < 0)
+      error("error read");
+    if (n == 0)
+      break;
+    uint64_t t = now_ns();
+    filled += (size_t)n;
+
+    char *start = buffer, *newline;
+    while ((newline = memchr(start, '\n', filled - (start - buffer)))) {
+      *newline = '\0';
+      record_line(start, t);
+      start = newline + 1;
+    }
+    filled -= (size_t)(start - buffer);
+    memmove(buffer, start, filled);
+    if (filled == RECV_BUFFER)
+      error("error line too long");
+  }
+}
+
+/* fds[0] is read by one side and fds[1] written by the other, whichever
+ * transport carries them. */
+void open_channel(int fds[2], int use_socket) {
+  if (use_socket ? socketpair(AF_UNIX, SOCK_STREAM, 0, fds) : pipe(fds))
+    error("error opening channel");
+}
+
+void run_rate(const char *classifier, double rate, int lanes,
+              int use_socket, double *achieved) {
+  int input[2], output[2];
+  open_channel(input, use_socket);
+  open_channel(output, use_socket);
+
+  pid_t pid = fork();
+  if (pid < 0)
+    error("error fork");
+  if (pid == 0) {
+    char lanes_arg[32];
+    snprintf(lanes_arg, sizeof(lanes_arg), "--lanes=%d", lanes);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(input[0], STDIN_FILENO);
+    dup2(output[1], STDOUT_FILENO);
+    if (devnull >= 0)
+      dup2(devnull, STDERR_FILENO);
+    close(input[0]);
+    close(input[1]);
+    close(output[0]);
+    close(output[1]);
+    execl(classifier, classifier, "-", "--dispatch", lanes_arg, (char *)NULL);
+    _exit(127);
+  }
+  close(input[0]);
+  close(output[1]);
+
+  for (int c = 0; c <= ALL_CLASSES; ++c)
+    hdr_init(&latency[c]);
+  received = unexpected = 0;
+  for (long i = 0; i < n_requests; ++i)
+    atomic_init(&send_ns[i], 0);
+
+  SenderArgs args = {input[1], rate};
+  pthread_t sender;
+  uint64_t start = now_ns();
+  if (pthread_create(&sender, NULL, sender_thread, (void *)&args) != 0)
+    error("thread creation");
+  receive(output[0]);
+  uint64_t end = now_ns();
+  pthread_join(sender, NULL);
+  close(output[0]);
+
+  int status;
+  if (waitpid(pid, &status, 0) < 0)
+    error("error waitpid");
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "El clasificador terminó con error (estado %d)\n",
+            status);
+    exit(EXIT_FAILURE);
+  }
+  *achieved = end > start ? received / ((end - start) / 1e9) : 0.0;
+}
+
+void print_rows(const char *transport, double rate, double achieved) {
+  for (int c = ALL_CLASSES; c >= 0; --c) {
+    const HdrHistogram *h = &latency[c];
+    printf("%s,%.0f,%.0f,%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f\n", transport, rate,
+           achieved, class_names[c], (unsigned long long)h->count,
+           hdr_percentile(h, 50.0) / 1e3, hdr_percentile(h, 90.0) / 1e3,
+           hdr_percentile(h, 99.0) / 1e3, hdr_percentile(h, 99.9) / 1e3,
+           h->count ? h->max / 1e3 : 0.0);
+  }
+  fflush(stdout);
+}
+
+#define USAGE                                                                  \
+  "Usage: <clasificador> [--requests=N] [--rates=r1,r2,...] "                  \
+  "[--mix=critical,urgent,invalid] [--transport=pipe|socket] [--lanes=N] "     \
+  "[--seed=S]"
+
+int main(int argc, char *argv[]) {
+  const char *classifier = NULL;
+  const char *rates_arg = "20000,50000,100000,200000,0";
+  double critical = 0.05, urgent = 0.25, invalid = 0.10;
+  int use_socket = 0, lanes = 1;
+  uint64_t seed = 42;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--requests=", 11) == 0 && atol(argv[i] + 11) > 0)
+      n_requests = atol(argv[i] + 11);
+    else if (strncmp(argv[i], "--rates=", 8) == 0)
+      rates_arg = argv[i] + 8;
+    else if (strncmp(argv[i], "--mix=", 6) == 0) {
+      if (sscanf(argv[i] + 6, "%lf,%lf,%lf", &critical, &urgent, &invalid) !=
+          3)
+        error(USAGE);
+    } else if (strcmp(argv[i], "--transport=pipe") == 0)
+      use_socket = 0;
+    else if (strcmp(argv[i], "--transport=socket") == 0)
+      use_socket = 1;
+    else if (strncmp(argv[i], "--lanes=", 8) == 0 && atoi(argv[i] + 8) > 0)
+      lanes = atoi(argv[i] + 8);
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (!classifier)
+      classifier = argv[i];
+    else
+      error(USAGE);
+  }
+  if (!classifier)
+    error(USAGE);
+
+  double rates[MAX_RATES];
+  int n_rates = 0;
+  for (const char *p = rates_arg; *p && n_rates < MAX_RATES;) {
+    rates[n_rates++] = atof(p);
+    p = strchr(p, ',');
+    if (!p)
+      break;
+    p++;
+  }
+
+  /* A classifier that dies early must show up as an error, not a signal. */
+  signal(SIGPIPE, SIG_IGN);
+  request_mix_init(&mix, critical, urgent, invalid, seed);
+  send_ns = (_Atomic uint64_t *)malloc(n_requests * sizeof(*send_ns));
+  if (!send_ns)
+    error("error malloc send times");
+
+  const char *transport = use_socket ? "socket" : "pipe";
+  printf("transporte,tasa_objetivo,tasa_real,clase,solicitudes,p50_us,p90_us,"
+         "p99_us,p999_us,max_us\n");
+  for (int r = 0; r < n_rates; ++r) {
+    double achieved;
+    run_rate(classifier, rates[r], lanes, use_socket, &achieved);
+    print_rows(transport, rates[r], achieved);
+    fprintf(stderr,
+            "Tasa %.0f/s: %ld de %ld recibidas a %.0f/s, p99 %.1f us, "
+            "%ld clasificaciones inesperadas\n",
+            rates[r], received, n_requests, achieved,
+            hdr_percentile(&latency[ALL_CLASSES], 99.0) / 1e3, unexpected);
+  }
+
+  free(send_ns);
+  return EXIT_SUCCESS;
+}
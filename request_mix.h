@@ -0,0 +1,85 @@
+#ifndef REQUEST_MIX_H
+#define REQUEST_MIX_H
+
+/* Header-only synthetic request lines for request_classification.c. Line i
+ * is a pure function of (seed, i): the kind is drawn with counter_rng.h and
+ * every line starts with "<tag>:<i> " so a consumer can tell which request
+ * it is looking at. Anything that is not critical, urgent or invalid is a
+ * well-formed request without URGENTE, which the default rules send to
+ * BAJA like the invalid ones. */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "counter_rng.h"
+
+#define MIX_LINE_MAX 128
+
+enum { MIX_NORMAL, MIX_URGENT, MIX_CRITICAL, MIX_INVALID };
+
+typedef struct {
+  double critical;
+  double urgent;
+  double invalid;
+  uint64_t key;
+} RequestMix;
+
+static inline void request_mix_init(RequestMix *mix, double critical,
+                                    double urgent, double invalid,
+                                    uint64_t seed) {
+  mix->critical = critical;
+  mix->urgent = urgent;
+  mix->invalid = invalid;
+  mix->key = crng_key(seed, 0);
+}
+
+static inline int request_mix_kind(const RequestMix *mix, uint64_t i) {
+  double u = crng_uniform(mix->key, 2 * i);
+  if (u < mix->critical)
+    return MIX_CRITICAL;
+  if ((u -= mix->critical) < mix->urgent)
+    return MIX_URGENT;
+  if ((u -= mix->urgent) < mix->invalid)
+    return MIX_INVALID;
+  return MIX_NORMAL;
+}
+
+/* Writes line i without a newline into buf and returns its length. */
+static inline int request_mix_line(const RequestMix *mix, uint64_t i,
+                                   char *buf) {
+  static const char *critical_words[] = {"servidor", "bloqueo", "caída"};
+  static const char *invalid_forms[] = {
+      "SOL:%llu URGENTE; sin prefijo REQ", "REQ:%llu URGENTE sin separador",
+      "req:%llu URGENTE; prefijo en minúsculas"};
+  uint64_t r = crng_u64(mix->key, 2 * i + 1);
+  unsigned long long id = (unsigned long long)i;
+
+  switch (request_mix_kind(mix, i)) {
+  case MIX_CRITICAL:
+    return snprintf(buf, MIX_LINE_MAX,
+                    "REQ:%llu URGENTE; %s no responde en nodo %u", id,
+                    critical_words[r % 3], (unsigned)(r >> 32) % 1000);
+  case MIX_URGENT:
+    return snprintf(buf, MIX_LINE_MAX, "REQ:%llu URGENTE; revisar cola %u", id,
+                    (unsigned)(r >> 32) % 1000);
+  case MIX_INVALID:
+    return snprintf(buf, MIX_LINE_MAX, invalid_forms[r % 3], id);
+  default:
+    return snprintf(buf, MIX_LINE_MAX, "REQ:%llu consulta; informe semanal %u",
+                    id, (unsigned)(r >> 32) % 1000);
+  }
+}
+
+/* Request id i of a line written by request_mix_line, or -1. */
+static inline long long request_mix_id(const char *line) {
+  while (*line && *line != ':')
+    line++;
+  if (*line != ':' || line[1] < '0' || line[1] > '9')
+    return -1;
+  long long id = 0;
+  for (line++; *line >= '0' && *line <= '9'; ++line)
+    id = id * 10 + (*line - '0');
+  return id;
+}
+
+#endif
@@ -1,19 +1,32 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blas1.h"
+
+#define STREAM_CHUNK_ELEMS (1 << 22)
+#define STREAM_BUFFERS 2
+#define DOUBLE_BLOCK_ELEMS 4096
+#define PAIRWISE_BASE 32
+#define BENCH_ELEMS_TARGET (1 << 26)
 
 int* vectorA;
 int* vectorB;
-int* product_vector;
 int v_size;
 
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
 typedef struct {
   int start;
   int end;
+  int64_t partial_sum;
 } ThreadArgs;
 
 void error(const char* err) {
@@ -48,66 +61,400 @@ void read_file(FILE *file, int** vectorA, int** vectorB, int* v_size) {
   fclose(file);
 }
 
+int64_t dot_range(const int* restrict a, const int* restrict b, int start, int end) {
+  int64_t sum = 0;
+  for (int i = start; i < end; ++i)
+    sum += (int64_t)a[i] * b[i];
+  return sum;
+}
+
 void* product(void* arg) {
   ThreadArgs* args = (ThreadArgs*)arg;
-  int start = args->start;
-  int end = args->end;
+  args->partial_sum = dot_range(vectorA, vectorB, args->start, args->end);
+
+  pthread_exit(NULL);
+  return NULL;
+}
+
+typedef enum { SUM_NAIVE, SUM_KAHAN, SUM_PAIRWISE } SumMode;
+
+const char* sum_mode_names[] = {"naive", "kahan", "pairwise"};
+
+double* vectorA_double;
+double* vectorB_double;
+double* block_sums;
+SumMode sum_mode = SUM_NAIVE;
+
+typedef struct {
+  int first_block;
+  int last_block;
+} DoubleThreadArgs;
+
+void read_file_double(FILE* file, double** vectorA, double** vectorB, int* v_size) {
+  fscanf(file, "%d", v_size);
+
+  *vectorA = (double*)malloc(*v_size * sizeof(double));
+  if (!(*vectorA)) error("error malloc read_file_double vectorA");
 
-  for (int i = start; i < end; ++i) {
+  for (int i = 0; i < *v_size; ++i)
+    fscanf(file, "%lf", &(*vectorA)[i]);
+
+  *vectorB = (double*)malloc(*v_size * sizeof(double));
+  if (!(*vectorB)) error("error malloc read_file_double vectorB");
 
-    pthread_mutex_lock(&mutex);
-    product_vector[i] = vectorA[i] * vectorB[i];
-    pthread_mutex_unlock(&mutex);
+  for (int i = 0; i < *v_size; ++i)
+    fscanf(file, "%lf", &(*vectorB)[i]);
 
-    println("VectorA[%d] * VectorB[%d] = %d", 
-            vectorA[i], vectorB[i], vectorA[i] * vectorB[i]);
+  fclose(file);
+}
+
+double dot_naive(const double* restrict a, const double* restrict b, int n) {
+  double sum = 0.0;
+  for (int i = 0; i < n; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+double dot_kahan(const double* restrict a, const double* restrict b, int n) {
+  double sum = 0.0;
+  double c = 0.0;
+  for (int i = 0; i < n; ++i) {
+    double y = a[i] * b[i] - c;
+    double t = sum + y;
+    c = (t - sum) - y;
+    sum = t;
+  }
+  return sum;
+}
+
+double dot_pairwise(const double* restrict a, const double* restrict b, int n) {
+  if (n <= PAIRWISE_BASE) return dot_naive(a, b, n);
+  int half = n / 2;
+  return dot_pairwise(a, b, half) + dot_pairwise(a + half, b + half, n - half);
+}
+
+double dot_block(const double* a, const double* b, int n, SumMode mode) {
+  switch (mode) {
+    case SUM_KAHAN: return dot_kahan(a, b, n);
+    case SUM_PAIRWISE: return dot_pairwise(a, b, n);
+    default: return dot_naive(a, b, n);
+  }
+}
+
+double sum_pairwise(const double* x, int n) {
+  if (n == 0) return 0.0;
+  if (n == 1) return x[0];
+  int half = n / 2;
+  return sum_pairwise(x, half) + sum_pairwise(x + half, n - half);
+}
+
+double reduce_block_sums(const double* x, int n, SumMode mode) {
+  if (mode == SUM_PAIRWISE) return sum_pairwise(x, n);
+
+  double sum = 0.0;
+  double c = 0.0;
+  for (int i = 0; i < n; ++i) {
+    if (mode == SUM_KAHAN) {
+      double y = x[i] - c;
+      double t = sum + y;
+      c = (t - sum) - y;
+      sum = t;
+    } else {
+      sum += x[i];
+    }
+  }
+  return sum;
+}
+
+/* Blocks have a fixed size and are reduced in index order afterwards, so the
+ * floating point result does not depend on how blocks map to threads. */
+void* product_double(void* arg) {
+  DoubleThreadArgs* args = (DoubleThreadArgs*)arg;
+
+  for (int blk = args->first_block; blk < args->last_block; ++blk) {
+    int start = blk * DOUBLE_BLOCK_ELEMS;
+    int n = v_size - start < DOUBLE_BLOCK_ELEMS ? v_size - start : DOUBLE_BLOCK_ELEMS;
+    block_sums[blk] = dot_block(vectorA_double + start, vectorB_double + start, n, sum_mode);
   }
 
   pthread_exit(NULL);
   return NULL;
 }
 
+double dot_double_threaded(int n_threads) {
+  int n_blocks = (v_size + DOUBLE_BLOCK_ELEMS - 1) / DOUBLE_BLOCK_ELEMS;
+
+  pthread_t threads[n_threads];
+  DoubleThreadArgs thread_args[n_threads];
+
+  for (int i = 0; i < n_threads; ++i) {
+    blas1_range(n_blocks, n_threads, i, &thread_args[i].first_block, &thread_args[i].last_block);
+
+    if (pthread_create(&threads[i], NULL, product_double, (void*)&thread_args[i]) != 0)
+      error("error pthread_create");
+  }
+
+  for (int i = 0; i < n_threads; ++i)
+    pthread_join(threads[i], NULL);
+
+  return reduce_block_sums(block_sums, n_blocks, sum_mode);
+}
+
+int double_main(FILE* file, int n_threads, int bench) {
+  read_file_double(file, &vectorA_double, &vectorB_double, &v_size);
+
+  int n_blocks = (v_size + DOUBLE_BLOCK_ELEMS - 1) / DOUBLE_BLOCK_ELEMS;
+  block_sums = (double*)malloc((n_blocks > 0 ? n_blocks : 1) * sizeof(double));
+  if (!block_sums) error("error malloc block_sums");
+
+  if (!bench) {
+    println("Scalar product (%s): %.17g", sum_mode_names[sum_mode], dot_double_threaded(n_threads));
+  } else {
+    int repetitions = v_size > 0 ? BENCH_ELEMS_TARGET / v_size : 1;
+    if (repetitions < 1) repetitions = 1;
+
+    for (int mode = SUM_NAIVE; mode <= SUM_PAIRWISE; ++mode) {
+      sum_mode = (SumMode)mode;
+      double result = 0.0;
+
+      struct timespec t_start, t_end;
+      clock_gettime(CLOCK_MONOTONIC, &t_start);
+      for (int r = 0; r < repetitions; ++r)
+        result = dot_double_threaded(n_threads);
+      clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+      double seconds = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+      double gigabytes = 2.0 * v_size * sizeof(double) * repetitions / 1e9;
+      println("%-9s result: %.17g  time: %.4f s  throughput: %.2f GB/s",
+              sum_mode_names[mode], result, seconds, gigabytes / seconds);
+    }
+  }
+
+  free(vectorA_double);
+  free(vectorB_double);
+  free(block_sums);
+
+  return EXIT_SUCCESS;
+}
+
+typedef struct {
+  int* a;
+  int* b;
+  int count;
+  int64_t chunk_id;
+  int pending_workers;
+} StreamBuffer;
+
+typedef struct {
+  int thread_id;
+  int n_threads;
+  int64_t partial_sum;
+} StreamWorkerArgs;
+
+StreamBuffer stream_buffers[STREAM_BUFFERS];
+int stream_fd_a;
+int stream_fd_b;
+pthread_mutex_t stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t stream_filled = PTHREAD_COND_INITIALIZER;
+pthread_cond_t stream_emptied = PTHREAD_COND_INITIALIZER;
+
+size_t read_full(int fd, void* dest, size_t bytes) {
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t n = read(fd, (char*)dest + done, bytes - done);
+    if (n < 0) error("error read stream chunk");
+    if (n == 0) break;
+    done += n;
+  }
+  return done;
+}
+
+/* Fills the two buffers alternately so the next chunk is already in memory
+ * while the workers reduce the current one. A chunk with count 0 marks EOF. */
+void* stream_reader(void* arg) {
+  int n_threads = *(int*)arg;
+
+  for (int64_t k = 0;; ++k) {
+    StreamBuffer* buf = &stream_buffers[k % STREAM_BUFFERS];
+
+    pthread_mutex_lock(&stream_mutex);
+    while (buf->pending_workers > 0)
+      pthread_cond_wait(&stream_emptied, &stream_mutex);
+    pthread_mutex_unlock(&stream_mutex);
+
+    size_t bytes_a = read_full(stream_fd_a, buf->a, STREAM_CHUNK_ELEMS * sizeof(int));
+    size_t bytes_b = read_full(stream_fd_b, buf->b, STREAM_CHUNK_ELEMS * sizeof(int));
+    int count = (int)((bytes_a < bytes_b ? bytes_a : bytes_b) / sizeof(int));
+
+    pthread_mutex_lock(&stream_mutex);
+    buf->count = count;
+    buf->chunk_id = k;
+    buf->pending_workers = n_threads;
+    pthread_cond_broadcast(&stream_filled);
+    pthread_mutex_unlock(&stream_mutex);
+
+    if (count == 0) break;
+  }
+
+  pthread_exit(NULL);
+  return NULL;
+}
+
+void* stream_worker(void* arg) {
+  StreamWorkerArgs* args = (StreamWorkerArgs*)arg;
+  int64_t sum = 0;
+
+  for (int64_t k = 0;; ++k) {
+    StreamBuffer* buf = &stream_buffers[k % STREAM_BUFFERS];
+
+    pthread_mutex_lock(&stream_mutex);
+    while (buf->chunk_id != k)
+      pthread_cond_wait(&stream_filled, &stream_mutex);
+    int count = buf->count;
+    pthread_mutex_unlock(&stream_mutex);
+
+    if (count == 0) break;
+
+    int start = (int)((int64_t)count * args->thread_id / args->n_threads);
+    int end = (int)((int64_t)count * (args->thread_id + 1) / args->n_threads);
+    sum += dot_range(buf->a, buf->b, start, end);
+
+    pthread_mutex_lock(&stream_mutex);
+    if (--buf->pending_workers == 0)
+      pthread_cond_signal(&stream_emptied);
+    pthread_mutex_unlock(&stream_mutex);
+  }
+
+  args->partial_sum = sum;
+  pthread_exit(NULL);
+  return NULL;
+}
+
+int open_stream_file(const char* filename, off_t* size) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) error("error opening stream file");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) error("error fstat stream file");
+  *size = st.st_size;
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  return fd;
+}
+
+int stream_main(const char* filename_a, const char* filename_b, int n_threads) {
+  off_t size_a, size_b;
+  stream_fd_a = open_stream_file(filename_a, &size_a);
+  stream_fd_b = open_stream_file(filename_b, &size_b);
+  if (size_a != size_b)
+    fprintf(stderr, "warning: vector files differ in size, using the shorter one\n");
+
+  for (int i = 0; i < STREAM_BUFFERS; ++i) {
+    stream_buffers[i].a = (int*)aligned_alloc(64, STREAM_CHUNK_ELEMS * sizeof(int));
+    stream_buffers[i].b = (int*)aligned_alloc(64, STREAM_CHUNK_ELEMS * sizeof(int));
+    if (!stream_buffers[i].a || !stream_buffers[i].b)
+      error("error aligned_alloc stream buffers");
+    stream_buffers[i].chunk_id = -1;
+    stream_buffers[i].pending_workers = 0;
+  }
+
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+  pthread_t reader;
+  pthread_t threads[n_threads];
+  StreamWorkerArgs worker_args[n_threads];
+
+  if (pthread_create(&reader, NULL, stream_reader, (void*)&n_threads) != 0)
+    error("error pthread_create reader");
+
+  for (int i = 0; i < n_threads; ++i) {
+    worker_args[i].thread_id = i;
+    worker_args[i].n_threads = n_threads;
+    if (pthread_create(&threads[i], NULL, stream_worker, (void*)&worker_args[i]) != 0)
+      error("error pthread_create");
+  }
+
+  int64_t scalar_product = 0;
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+    scalar_product += worker_args[i].partial_sum;
+  }
+  pthread_join(reader, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  double seconds = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+  off_t elems = (size_a < size_b ? size_a : size_b) / (off_t)sizeof(int);
+  double gigabytes = 2.0 * elems * sizeof(int) / 1e9;
+
+  println("Scalar product: %" PRId64, scalar_product);
+  println("Elements: %lld, time: %.3f s, throughput: %.2f GB/s",
+          (long long)elems, seconds, gigabytes / seconds);
+
+  for (int i = 0; i < STREAM_BUFFERS; ++i) {
+    free(stream_buffers[i].a);
+    free(stream_buffers[i].b);
+  }
+  close(stream_fd_a);
+  close(stream_fd_b);
+
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char* argv[]) {
-  if(argc != 3) error("Usage: <filename> <n_threads>");
+  if (argc == 5 && strcmp(argv[1], "--stream") == 0) {
+    int n_threads = atoi(argv[4]);
+    if (n_threads <= 0) error("n_threads must be greater than 0");
+    return stream_main(argv[2], argv[3], n_threads);
+  }
+
+  if (argc < 3)
+    error("Usage: <filename> <n_threads> [--type=int|double] [--sum=naive|kahan|pairwise] [--bench]"
+          " | --stream <binA> <binB> <n_threads>");
+
+  int use_double = 0;
+  int bench = 0;
+  for (int i = 3; i < argc; ++i) {
+    if (strcmp(argv[i], "--type=double") == 0) use_double = 1;
+    else if (strcmp(argv[i], "--type=int") == 0) use_double = 0;
+    else if (strcmp(argv[i], "--sum=naive") == 0) sum_mode = SUM_NAIVE;
+    else if (strcmp(argv[i], "--sum=kahan") == 0) sum_mode = SUM_KAHAN;
+    else if (strcmp(argv[i], "--sum=pairwise") == 0) sum_mode = SUM_PAIRWISE;
+    else if (strcmp(argv[i], "--bench") == 0) bench = 1;
+    else error("unknown option");
+  }
 
   const char* filename = argv[1];
   FILE* file = fopen(filename, "r");
   if (!file) error("error opening file");
 
-  read_file(file, &vectorA, &vectorB, &v_size);
+  int n_threads = atoi(argv[2]);
+  if (n_threads <= 0) error("n_threads must be greater than 0");
 
-  product_vector = (int*)malloc(v_size * sizeof(int));
+  if (use_double) return double_main(file, n_threads, bench);
 
-  int n_threads = atoi(argv[2]);
+  read_file(file, &vectorA, &vectorB, &v_size);
 
   pthread_t threads[n_threads];
   ThreadArgs thread_args[n_threads];
 
-  int elements_per_thread = v_size / n_threads;
-  int remainder = v_size % n_threads;
-  int current_index = 0;
-
   for (int i = 0; i < n_threads; ++i) {
-    thread_args[i].start = current_index;
-    thread_args[i].end = current_index + elements_per_thread + (i < remainder ? 1 : 0);
+    blas1_range(v_size, n_threads, i, &thread_args[i].start, &thread_args[i].end);
 
     if (pthread_create(&threads[i], NULL, product, (void*)&thread_args[i]) != 0)
       error("error pthread_create");
-
-    current_index = thread_args[i].end;
   }
 
-  for (int i = 0; i < n_threads; ++i)
+  int64_t scalar_product = 0;
+  for (int i = 0; i < n_threads; ++i) {
     pthread_join(threads[i], NULL);
+    scalar_product += thread_args[i].partial_sum;
+  }
 
-  println("");
-  for (int i = 0; i < v_size; ++i)
-    printf("%d ", product_vector[i]);
-  println("");
+  println("Scalar product: %" PRId64, scalar_product);
 
   free(vectorA);
   free(vectorB);
-  free(product_vector);
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Single-file mode and --tree must report the same line and comment counts
+# for the same file; the fixture also pins the expected numbers.
+set -e
+cd "$(dirname "$0")/.."
+bin=$(mktemp)
+trap 'rm -f "$bin"' EXIT
+cc -O2 -pthread code_analyzer.c -o "$bin" -lm
+
+counts() {
+  "$bin" "$@" --format=csv | sed -n 2p | cut -d, -f2,3
+}
+
+status=0
+for f in tests/comments_fixture.c *.c; do
+  single=$(counts "$f")
+  tree=$(counts --tree "$f")
+  if [ "$single" != "$tree" ]; then
+    echo "FAIL $f: single-file $single, tree $tree"
+    status=1
+  fi
+done
+
+expected="16,11"
+got=$(counts tests/comments_fixture.c)
+if [ "$got" != "$expected" ]; then
+  echo "FAIL tests/comments_fixture.c: expected $expected, got $got"
+  status=1
+fi
+
+[ $status -eq 0 ] && echo "comment counts: ok"
+exit $status
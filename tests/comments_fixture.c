@@ -0,0 +1,16 @@
+// line 1: line comment
+int a = 1; // line 2: trailing line comment
+char *s = "// not a comment";
+char c = '"'; // line 4: after a char literal holding a quote
+char *t = "escaped \" // still a string";
+/* line 6: block on one line */
+int b = 2; /* line 7: block opens
+   line 8: inside the block
+
+   line 10: the blank line above is not counted
+   line 11: block closes */ int d = 3;
+int e = 4 /* line 12 */ + 5;
+int f = '/' / 2;
+char *u = "/* not a block */";
+int g = 6; /*/ line 15: still open
+   line 16: closes */